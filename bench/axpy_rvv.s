@@ -0,0 +1,49 @@
+# axpy: y[i] = ((3 * x[i] + y[i]) << 1) ^ x[i] over 1024 int32 elements with
+# e32/m1 groups, 64 times, then the sum of y in a0. One register per group
+# is 16 bytes at VLEN=128 and 32 at VLEN=256.
+	li s0, 0x80002000	# x[i] = i
+	li s1, 0x80003000	# y[i] = 1
+	li s2, 64		# repetitions
+	li s3, 4096		# bytes per vector
+	li s4, 3		# a
+	mv t0, s0
+	mv t1, s1
+	add t2, s0, s3
+	li t3, 0
+	li t4, 1
+init:
+	sw t3, 0(t0)
+	sw t4, 0(t1)
+	addi t0, t0, 4
+	addi t1, t1, 4
+	addi t3, t3, 1
+	bne t0, t2, init
+rep:
+	mv t0, s0
+	mv t1, s1
+	li t5, 1024
+axpy:
+	vsetvli t4, t5, e32, m1
+	vle32.v v1, (t0)
+	vle32.v v2, (t1)
+	vmul.vx v3, v1, s4
+	vadd.vv v3, v3, v2
+	vsll.vi v3, v3, 1
+	vxor.vv v3, v3, v1
+	vse32.v v3, (t1)
+	slli t6, t4, 2
+	add t0, t0, t6
+	add t1, t1, t6
+	sub t5, t5, t4
+	bne t5, zero, axpy
+	addi s2, s2, -1
+	bne s2, zero, rep
+	li a0, 0
+	mv t1, s1
+	add t2, s1, s3
+sum:
+	lw t4, 0(t1)
+	add a0, a0, t4
+	addi t1, t1, 4
+	bne t1, t2, sum
+	ebreak
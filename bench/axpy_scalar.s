@@ -0,0 +1,44 @@
+# axpy: y[i] = ((3 * x[i] + y[i]) << 1) ^ x[i] over 1024 int32 elements, 64 times,
+# then the sum of y in a0
+	li s0, 0x80002000	# x[i] = i
+	li s1, 0x80003000	# y[i] = 1
+	li s2, 64		# repetitions
+	li s3, 4096		# bytes per vector
+	li s4, 3		# a
+	mv t0, s0
+	mv t1, s1
+	add t2, s0, s3
+	li t3, 0
+	li t4, 1
+init:
+	sw t3, 0(t0)
+	sw t4, 0(t1)
+	addi t0, t0, 4
+	addi t1, t1, 4
+	addi t3, t3, 1
+	bne t0, t2, init
+rep:
+	mv t0, s0
+	mv t1, s1
+axpy:
+	lw t3, 0(t0)
+	lw t4, 0(t1)
+	mul t5, t3, s4
+	add t5, t5, t4
+	slli t5, t5, 1
+	xor t5, t5, t3
+	sw t5, 0(t1)
+	addi t0, t0, 4
+	addi t1, t1, 4
+	bne t0, t2, axpy
+	addi s2, s2, -1
+	bne s2, zero, rep
+	li a0, 0
+	mv t1, s1
+	add t2, s1, s3
+sum:
+	lw t4, 0(t1)
+	add a0, a0, t4
+	addi t1, t1, 4
+	bne t1, t2, sum
+	ebreak
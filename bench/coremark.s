@@ -0,0 +1,146 @@
+# CoreMark-style mix, 128 times: walk and reverse a 64 node linked list,
+# multiply two 8x8 matrices, run a state machine over 512 input bytes and
+# fold the results into a crc16. The checksum ends in a0.
+	li s0, 0x80002000	# list: 64 nodes of next, value
+	li s1, 0x80003000	# matrices A, B and C, 8x8 words each
+	li s2, 0x80004000	# state machine input, 512 bytes
+	li s3, 128		# repetitions
+	li s4, 12345		# lcg state
+	li s5, 1103515245	# lcg multiplier
+	li s6, 12345		# lcg increment
+	li a0, 0		# crc
+	mv t0, s0		# build the list
+	li t1, 64
+list_init:
+	mul s4, s4, s5
+	add s4, s4, s6
+	addi t2, t0, 8
+	sw t2, 0(t0)
+	srli t3, s4, 16
+	sw t3, 4(t0)
+	mv t0, t2
+	addi t1, t1, -1
+	bne t1, zero, list_init
+	sw zero, -8(t0)
+	mv t0, s1		# A and B
+	li t1, 128
+matrix_init:
+	mul s4, s4, s5
+	add s4, s4, s6
+	srai t3, s4, 20
+	sw t3, 0(t0)
+	addi t0, t0, 4
+	addi t1, t1, -1
+	bne t1, zero, matrix_init
+	mv t0, s2		# input: digits, letters and others
+	li t1, 512
+input_init:
+	mul s4, s4, s5
+	add s4, s4, s6
+	srli t3, s4, 24
+	andi t3, t3, 0x7f
+	sb t3, 0(t0)
+	addi t0, t0, 1
+	addi t1, t1, -1
+	bne t1, zero, input_init
+rep:
+	li a1, 0		# list: sum and max of the values, each one bumped
+	li a2, 0
+	mv t0, s0
+walk:
+	lw t1, 4(t0)
+	addi t1, t1, 1
+	sw t1, 4(t0)
+	add a1, a1, t1
+	bgeu a2, t1, walk_next
+	mv a2, t1
+walk_next:
+	lw t0, 0(t0)
+	bne t0, zero, walk
+	li t2, 0		# reverse it
+	mv t0, s0
+reverse:
+	lw t1, 0(t0)
+	sw t2, 0(t0)
+	mv t2, t0
+	mv t0, t1
+	bne t0, zero, reverse
+	mv s0, t2
+	li a3, 0		# C = A * B, a3 sums C
+	li t0, 0		# i * 32
+matrix_i:
+	li t1, 0		# j * 4
+matrix_j:
+	li t4, 0
+	li t2, 0		# k
+	add t5, s1, t0		# &A[i][0]
+	addi t6, s1, 256
+	add t6, t6, t1		# &B[0][j]
+matrix_k:
+	lw t3, 0(t5)
+	lw a4, 0(t6)
+	mul t3, t3, a4
+	add t4, t4, t3
+	addi t5, t5, 4
+	addi t6, t6, 32
+	addi t2, t2, 1
+	slti a4, t2, 8
+	bne a4, zero, matrix_k
+	addi t5, s1, 512
+	add t5, t5, t0
+	add t5, t5, t1
+	sw t4, 0(t5)
+	add a3, a3, t4
+	addi t1, t1, 4
+	slti a4, t1, 32
+	bne a4, zero, matrix_j
+	addi t0, t0, 32
+	slti a4, t0, 256
+	bne a4, zero, matrix_i
+	li a5, 0		# state machine: 0 other, 1 number, 2 word; a5 counts tokens
+	li a6, 0		# state
+	mv t0, s2
+	addi t1, s2, 512
+scan:
+	lbu t2, 0(t0)
+	addi t3, t2, -48
+	sltiu t3, t3, 10
+	bne t3, zero, digit
+	ori t4, t2, 0x20
+	addi t4, t4, -97
+	sltiu t4, t4, 26
+	bne t4, zero, letter
+	li a6, 0
+	j scan_next
+digit:
+	li t5, 1
+	beq a6, t5, scan_next
+	beq a6, zero, token
+	j scan_next
+letter:
+	li t5, 2
+	beq a6, t5, scan_next
+token:
+	addi a5, a5, 1
+	mv a6, t5
+scan_next:
+	addi t0, t0, 1
+	bne t0, t1, scan
+	xor t0, a1, a2		# crc16 of the results
+	xor t0, t0, a3
+	xor t0, t0, a5
+	li t1, 32
+	li t6, 0xa001
+crc:
+	xor t2, a0, t0
+	andi t2, t2, 1
+	srli a0, a0, 1
+	beq t2, zero, crc_next
+	xor a0, a0, t6
+crc_next:
+	srli t0, t0, 1
+	addi t1, t1, -1
+	bne t1, zero, crc
+	addi s3, s3, -1
+	bne s3, zero, rep
+	ebreak
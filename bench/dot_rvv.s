@@ -0,0 +1,59 @@
+# dot product of two 1024 element int32 vectors with e32/m8 groups, 16 times, result in a0,
+# then of a with b reversed, read with a stride of -4, result in a1
+	li s0, 0x80002000	# a[i] = i
+	li s1, 0x80003000	# b[i] = 3 * i + 1
+	li s2, 16		# repetitions
+	li s3, 4096		# bytes per vector
+	mv t0, s0
+	mv t1, s1
+	add t2, s0, s3
+	li t3, 0
+	li t4, 1
+init:
+	sw t3, 0(t0)
+	sw t4, 0(t1)
+	addi t0, t0, 4
+	addi t1, t1, 4
+	addi t3, t3, 1
+	addi t4, t4, 3
+	bne t0, t2, init
+rep:
+	vsetivli zero, 1, e32, m1
+	vmv.s.x v24, zero
+	mv t0, s0
+	mv t1, s1
+	li t5, 1024
+dot:
+	vsetvli t4, t5, e32, m8
+	vle32.v v0, (t0)
+	vle32.v v8, (t1)
+	vmul.vv v16, v0, v8
+	vredsum.vs v24, v16, v24
+	slli t6, t4, 2
+	add t0, t0, t6
+	add t1, t1, t6
+	sub t5, t5, t4
+	bne t5, zero, dot
+	vmv.x.s a0, v24
+	vsetivli zero, 1, e32, m1
+	vmv.s.x v24, zero
+	mv t0, s0
+	add t1, s1, s3
+	addi t1, t1, -4		# last element of b
+	li a2, -4
+	li t5, 1024
+rdot:
+	vsetvli t4, t5, e32, m8
+	vle32.v v0, (t0)
+	vlse32.v v8, (t1), a2
+	vmul.vv v16, v0, v8
+	vredsum.vs v24, v16, v24
+	slli t6, t4, 2
+	add t0, t0, t6
+	sub t1, t1, t6
+	sub t5, t5, t4
+	bne t5, zero, rdot
+	vmv.x.s a1, v24
+	addi s2, s2, -1
+	bne s2, zero, rep
+	ebreak
@@ -0,0 +1,45 @@
+# dot product of two 1024 element int32 vectors, 16 times, result in a0,
+# then of a with b reversed, result in a1
+	li s0, 0x80002000	# a[i] = i
+	li s1, 0x80003000	# b[i] = 3 * i + 1
+	li s2, 16		# repetitions
+	li s3, 4096		# bytes per vector
+	mv t0, s0
+	mv t1, s1
+	add t2, s0, s3
+	li t3, 0
+	li t4, 1
+init:
+	sw t3, 0(t0)
+	sw t4, 0(t1)
+	addi t0, t0, 4
+	addi t1, t1, 4
+	addi t3, t3, 1
+	addi t4, t4, 3
+	bne t0, t2, init
+rep:
+	li a0, 0
+	mv t0, s0
+	mv t1, s1
+dot:
+	lw t3, 0(t0)
+	lw t4, 0(t1)
+	mul t3, t3, t4
+	add a0, a0, t3
+	addi t0, t0, 4
+	addi t1, t1, 4
+	bne t0, t2, dot
+	li a1, 0
+	mv t0, s0
+	add t1, s1, s3
+rdot:
+	addi t1, t1, -4
+	lw t3, 0(t0)
+	lw t4, 0(t1)
+	mul t3, t3, t4
+	add a1, a1, t3
+	addi t0, t0, 4
+	bne t0, t2, rdot
+	addi s2, s2, -1
+	bne s2, zero, rep
+	ebreak
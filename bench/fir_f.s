@@ -0,0 +1,61 @@
+# fir: 16-tap FIR filter over 1024 float samples with flw/fmadd.s/fsw, twice,
+# then the sum of the 1008 outputs as integer words in a0. The samples and
+# taps are multiples of 0.25, so every product and sum is exact and the
+# result is the same bits as fir_soft, which does the same with soft-float.
+	li s0, 0x80002000	# x[i] = xt[i % 16]
+	li s1, 0x80001040	# h
+	li s3, 0x80003000	# y
+	li s2, 2		# repetitions
+	li t0, 0x80001000	# xt
+	mv t1, s0
+	li t2, 1024
+init:
+	andi t3, t2, 15
+	slli t3, t3, 2
+	add t3, t3, t0
+	lw t4, 0(t3)
+	sw t4, 0(t1)
+	addi t1, t1, 4
+	addi t2, t2, -1
+	bne t2, zero, init
+rep:
+	mv s5, s0
+	mv s6, s3
+	li s7, 1008		# outputs
+outer:
+	fmv.w.x fa0, zero
+	mv t0, s5
+	mv t1, s1
+	li t2, 16
+tap:
+	flw ft0, 0(t0)
+	flw ft1, 0(t1)
+	fmadd.s fa0, ft0, ft1, fa0
+	addi t0, t0, 4
+	addi t1, t1, 4
+	addi t2, t2, -1
+	bne t2, zero, tap
+	fsw fa0, 0(s6)
+	addi s5, s5, 4
+	addi s6, s6, 4
+	addi s7, s7, -1
+	bne s7, zero, outer
+	addi s2, s2, -1
+	bne s2, zero, rep
+	li a0, 0
+	mv t1, s3
+	li t2, 1008
+sum:
+	lw t4, 0(t1)
+	add a0, a0, t4
+	addi t1, t1, 4
+	addi t2, t2, -1
+	bne t2, zero, sum
+	ebreak
+	.org 0x80001000
+	# xt: -8.0 to 7.0
+	.word 0xc1000000, 0xc0e00000, 0xc0c00000, 0xc0a00000, 0xc0800000, 0xc0400000, 0xc0000000, 0xbf800000
+	.word 0x00000000, 0x3f800000, 0x40000000, 0x40400000, 0x40800000, 0x40a00000, 0x40c00000, 0x40e00000
+	# h: 0.25 to 4.0
+	.word 0x3e800000, 0x3f000000, 0x3f400000, 0x3f800000, 0x3fa00000, 0x3fc00000, 0x3fe00000, 0x40000000
+	.word 0x40100000, 0x40200000, 0x40300000, 0x40400000, 0x40500000, 0x40600000, 0x40700000, 0x40800000
@@ -0,0 +1,201 @@
+# fir: the fir_f filter on RV32IM with soft-float, as a guest without the F
+# extension runs it: each tap is a call to fmul and one to fadd. They take
+# normal numbers or zero, round to nearest even and don't handle overflow,
+# underflow, infinities or NaN, which this data never produces.
+	li s0, 0x80002000	# x[i] = xt[i % 16]
+	li s1, 0x80001040	# h
+	li s3, 0x80003000	# y
+	li s2, 2		# repetitions
+	li t0, 0x80001000	# xt
+	mv t1, s0
+	li t2, 1024
+init:
+	andi t3, t2, 15
+	slli t3, t3, 2
+	add t3, t3, t0
+	lw t4, 0(t3)
+	sw t4, 0(t1)
+	addi t1, t1, 4
+	addi t2, t2, -1
+	bne t2, zero, init
+rep:
+	mv s5, s0
+	mv s6, s3
+	li s7, 1008		# outputs
+outer:
+	li s8, 0		# sum
+	mv s9, s5
+	mv s10, s1
+	li s11, 16
+tap:
+	lw a0, 0(s9)
+	lw a1, 0(s10)
+	jal ra, fmul
+	mv a1, s8
+	jal ra, fadd
+	mv s8, a0
+	addi s9, s9, 4
+	addi s10, s10, 4
+	addi s11, s11, -1
+	bne s11, zero, tap
+	sw s8, 0(s6)
+	addi s5, s5, 4
+	addi s6, s6, 4
+	addi s7, s7, -1
+	bne s7, zero, outer
+	addi s2, s2, -1
+	bne s2, zero, rep
+	li a0, 0
+	mv t1, s3
+	li t2, 1008
+sum:
+	lw t4, 0(t1)
+	add a0, a0, t4
+	addi t1, t1, 4
+	addi t2, t2, -1
+	bne t2, zero, sum
+	ebreak
+
+# a0 = a0 * a1
+fmul:
+	xor t0, a0, a1
+	srli t0, t0, 31
+	slli t0, t0, 31		# sign
+	srli t1, a0, 23
+	andi t1, t1, 255
+	srli t2, a1, 23
+	andi t2, t2, 255
+	beq t1, zero, fmul_zero
+	beq t2, zero, fmul_zero
+	li t6, 0x800000
+	slli t3, a0, 9
+	srli t3, t3, 9
+	or t3, t3, t6		# mantissas with the hidden bit
+	slli t4, a1, 9
+	srli t4, t4, 9
+	or t4, t4, t6
+	add t1, t1, t2
+	addi t1, t1, -126	# exponent for a product in [2, 4)
+	mul t5, t3, t4		# 48 bit product in t6:t5
+	mulhu t6, t3, t4
+	slli t6, t6, 16		# its top 32 bits in t6, the rest in t5
+	srli t2, t5, 16
+	or t6, t6, t2
+	slli t5, t5, 16
+	blt t6, zero, fmul_round
+	slli t6, t6, 1		# in [1, 2)
+	srli t2, t5, 31
+	or t6, t6, t2
+	slli t5, t5, 1
+	addi t1, t1, -1
+fmul_round:
+	srli t3, t6, 8		# 24 bit mantissa
+	andi t2, t6, 255	# round bits
+	sltu t5, zero, t5	# sticky
+	j fpack
+fmul_zero:
+	mv a0, t0
+	jalr zero, 0(ra)
+
+# a0 = a0 + a1
+fadd:
+	slli t1, a0, 1
+	slli t2, a1, 1
+	bgeu t1, t2, fadd_big
+	mv t0, a0		# a0 gets the larger magnitude
+	mv a0, a1
+	mv a1, t0
+fadd_big:
+	slli t1, a0, 1
+	beq t1, zero, fadd_zeros
+	srli t2, a1, 23
+	andi t2, t2, 255
+	beq t2, zero, fadd_done	# a1 is zero
+	srli t1, a0, 23
+	andi t1, t1, 255
+	srli t0, a0, 31
+	slli t0, t0, 31		# sign of the larger
+	li t6, 0x800000
+	slli t3, a0, 9
+	srli t3, t3, 9
+	or t3, t3, t6
+	slli t4, a1, 9
+	srli t4, t4, 9
+	or t4, t4, t6
+	slli t3, t3, 6		# 6 guard bits
+	slli t4, t4, 6
+	sub t5, t1, t2		# align the smaller, keeping a sticky bit
+	beq t5, zero, fadd_op
+	li t6, 31
+	bltu t5, t6, fadd_shift
+	li t4, 1
+	j fadd_op
+fadd_shift:
+	sub t6, zero, t5
+	sll t6, t4, t6		# the bits shifted out
+	srl t4, t4, t5
+	sltu t6, zero, t6
+	or t4, t4, t6
+fadd_op:
+	xor t6, a0, a1
+	blt t6, zero, fadd_sub
+	add t3, t3, t4
+	srli t6, t3, 30
+	beq t6, zero, fadd_norm
+	andi t6, t3, 1
+	srli t3, t3, 1
+	or t3, t3, t6
+	addi t1, t1, 1
+	j fadd_norm
+fadd_sub:
+	sub t3, t3, t4
+	beq t3, zero, fadd_cancel
+	li t6, 0x20000000
+fadd_left:
+	bgeu t3, t6, fadd_norm
+	slli t3, t3, 1
+	addi t1, t1, -1
+	j fadd_left
+fadd_norm:
+	slli t2, t3, 2
+	andi t2, t2, 255	# round bits
+	srli t3, t3, 6		# 24 bit mantissa
+	li t5, 0		# the sticky bit is in the round bits
+	j fpack
+fadd_zeros:
+	and a0, a0, a1		# -0 only for -0 + -0
+fadd_done:
+	jalr zero, 0(ra)
+fadd_cancel:
+	li a0, 0
+	jalr zero, 0(ra)
+
+# a0 = sign t0, exponent t1 and 24 bit mantissa t3 rounded to nearest even
+# on the round bits t2 (0x80 is half) and the sticky bit t5
+fpack:
+	li t4, 128
+	bltu t4, t2, fpack_up
+	bne t2, t4, fpack_done
+	bne t5, zero, fpack_up
+	andi t4, t3, 1
+	beq t4, zero, fpack_done
+fpack_up:
+	addi t3, t3, 1
+	srli t4, t3, 24
+	beq t4, zero, fpack_done
+	srli t3, t3, 1
+	addi t1, t1, 1
+fpack_done:
+	slli t3, t3, 9
+	srli t3, t3, 9
+	slli t1, t1, 23
+	or a0, t0, t1
+	or a0, a0, t3
+	jalr zero, 0(ra)
+	.org 0x80001000
+	# xt: -8.0 to 7.0
+	.word 0xc1000000, 0xc0e00000, 0xc0c00000, 0xc0a00000, 0xc0800000, 0xc0400000, 0xc0000000, 0xbf800000
+	.word 0x00000000, 0x3f800000, 0x40000000, 0x40400000, 0x40800000, 0x40a00000, 0x40c00000, 0x40e00000
+	# h: 0.25 to 4.0
+	.word 0x3e800000, 0x3f000000, 0x3f400000, 0x3f800000, 0x3fa00000, 0x3fc00000, 0x3fe00000, 0x40000000
+	.word 0x40100000, 0x40200000, 0x40300000, 0x40400000, 0x40500000, 0x40600000, 0x40700000, 0x40800000
@@ -0,0 +1,20 @@
+# memcpy: copy 4 KiB with e8/m8 vector groups, 64 times
+	li s0, 0x80002000	# src
+	li s1, 0x80003000	# dst
+	li s2, 64		# repetitions
+	li s3, 4096		# bytes
+rep:
+	mv t0, s0
+	mv t1, s1
+	mv t5, s3
+copy:
+	vsetvli t4, t5, e8, m8
+	vle8.v v0, (t0)
+	vse8.v v0, (t1)
+	add t0, t0, t4
+	add t1, t1, t4
+	sub t5, t5, t4
+	bne t5, zero, copy
+	addi s2, s2, -1
+	bne s2, zero, rep
+	ebreak
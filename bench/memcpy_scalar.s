@@ -0,0 +1,18 @@
+# memcpy: copy 4 KiB word by word, 64 times
+	li s0, 0x80002000	# src
+	li s1, 0x80003000	# dst
+	li s2, 64		# repetitions
+	li s3, 4096		# bytes
+rep:
+	mv t0, s0
+	mv t1, s1
+	add t2, s0, s3
+copy:
+	lw t3, 0(t0)
+	sw t3, 0(t1)
+	addi t0, t0, 4
+	addi t1, t1, 4
+	bne t0, t2, copy
+	addi s2, s2, -1
+	bne s2, zero, rep
+	ebreak
@@ -0,0 +1,20 @@
+# memset: fill 8 KiB with a word pattern using e32/m8 groups, 64 times
+	li s0, 0x80002000	# dst
+	li s2, 64		# repetitions
+	li s3, 2048		# words
+	li s4, 0x5a5a5a5a	# pattern
+	vsetvli t4, zero, e32, m8
+	vmv.v.x v8, s4
+rep:
+	mv t0, s0
+	mv t5, s3
+fill:
+	vsetvli t4, t5, e32, m8
+	vse32.v v8, (t0)
+	slli t6, t4, 2
+	add t0, t0, t6
+	sub t5, t5, t4
+	bne t5, zero, fill
+	addi s2, s2, -1
+	bne s2, zero, rep
+	ebreak
@@ -0,0 +1,15 @@
+# memset: fill 8 KiB with a word pattern, 64 times
+	li s0, 0x80002000	# dst
+	li s2, 64		# repetitions
+	li s3, 8192		# bytes
+	li s4, 0x5a5a5a5a	# pattern
+rep:
+	mv t0, s0
+	add t2, s0, s3
+fill:
+	sw s4, 0(t0)
+	addi t0, t0, 4
+	bne t0, t2, fill
+	addi s2, s2, -1
+	bne s2, zero, rep
+	ebreak
@@ -0,0 +1,58 @@
+# memset and memcpy stress, 16 times: fill 4 KiB with sb, sh and sw, then
+# copy it with lb/sb, lh/sh and lw/sw. The sum of the copy ends in a0.
+	li s0, 0x80002000	# source
+	li s1, 0x80003000	# destination
+	li s2, 4096
+	li s3, 16		# repetitions
+	li a0, 0
+rep:
+	mv t0, s0		# memset, bytes
+	add t1, s0, s2
+	andi t2, s3, 0xff
+set8:
+	sb t2, 0(t0)
+	addi t0, t0, 1
+	bne t0, t1, set8
+	mv t0, s0		# memset, halves
+	slli t3, t2, 8
+	or t2, t2, t3
+set16:
+	sh t2, 0(t0)
+	addi t0, t0, 2
+	bne t0, t1, set16
+	mv t0, s0		# memset, words
+	slli t3, t2, 16
+	or t2, t2, t3
+set32:
+	sw t2, 0(t0)
+	addi t0, t0, 4
+	bne t0, t1, set32
+	mv t0, s0		# memcpy, bytes
+	mv t1, s1
+	add t2, s0, s2
+copy8:
+	lb t3, 0(t0)
+	sb t3, 0(t1)
+	addi t0, t0, 1
+	addi t1, t1, 1
+	bne t0, t2, copy8
+	mv t0, s0		# memcpy, halves
+	mv t1, s1
+copy16:
+	lh t3, 0(t0)
+	sh t3, 0(t1)
+	addi t0, t0, 2
+	addi t1, t1, 2
+	bne t0, t2, copy16
+	mv t0, s0		# memcpy, words, summing
+	mv t1, s1
+copy32:
+	lw t3, 0(t0)
+	sw t3, 0(t1)
+	add a0, a0, t3
+	addi t0, t0, 4
+	addi t1, t1, 4
+	bne t0, t2, copy32
+	addi s3, s3, -1
+	bne s3, zero, rep
+	ebreak
@@ -0,0 +1,37 @@
+# mul, mulh, mulhsu, mulhu, div, divu, rem and remu over 65536 lcg values,
+# including division by zero and by -1. The checksum ends in a0.
+	li s0, 65536
+	li s4, 1		# lcg state
+	li s5, 1103515245
+	li s6, 12345
+	li a0, 0
+loop:
+	mul s4, s4, s5
+	add s4, s4, s6
+	srai t0, s4, 7		# divisor: 0, -1 and small values show up
+	andi t1, s0, 255
+	beq t1, zero, by_zero
+	li t2, 255
+	bne t1, t2, divide
+	li t0, -1
+	j divide
+by_zero:
+	li t0, 0
+divide:
+	mulh t2, s4, s5
+	mulhsu t3, s4, s5
+	mulhu t4, s4, s5
+	div t5, s4, t0
+	divu t6, s4, t0
+	rem a1, s4, t0
+	remu a2, s4, t0
+	add a0, a0, t2
+	xor a0, a0, t3
+	add a0, a0, t4
+	xor a0, a0, t5
+	add a0, a0, t6
+	xor a0, a0, a1
+	add a0, a0, a2
+	addi s0, s0, -1
+	bne s0, zero, loop
+	ebreak
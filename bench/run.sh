@@ -0,0 +1,57 @@
+#!/bin/sh
+# Runs every program in this directory in every mode and prints the --stats
+# of each run as a JSON array: instructions, load_ns (readfile), run_ns,
+# cpu_ns, ns_per_instruction, mips and max_rss_kb, plus the exit code.
+# usage: bench/run.sh [emulator]   (default: builds ../poximv2.c with -march=native)
+# RUNS=n keeps the run with the lowest cpu_ns of n (default 3). The lanes
+# mode runs LANES copies of the program in lockstep (default 64); they
+# never diverge, so it is the best case of --lanes. A run that prints no
+# stats, such as one killed by a signal, stops the script with exit 1.
+cd "$(dirname "$0")" || exit 1
+emu=${1:-./poximv2}
+if [ -z "$1" ]; then
+	${CC:-cc} -O2 -march=native -o "$emu" ../poximv2.c -lm -lpthread || exit 1
+fi
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+i=0
+while [ $i -lt "${LANES:-64}" ]; do
+	echo "tp=$i"
+	i=$((i + 1))
+done > "$tmp/lanes"
+
+# run program mode options...
+run() {
+	hex=$1 mode=$2
+	shift 2
+	best= best_ns=
+	i=0
+	while [ $i -lt "${RUNS:-3}" ]; do
+		"$emu" --stats "$@" "$hex" "$tmp/out" > /dev/null 2> "$tmp/err"
+		code=$?
+		stats=$(grep '^{' "$tmp/err" | tail -n 1)
+		if [ -z "$stats" ]; then
+			echo "$0: $hex $mode: no stats, exit $code" >&2
+			exit 1
+		fi
+		ns=$(echo "$stats" | sed -n 's/.*"cpu_ns":\([0-9]*\).*/\1/p')
+		if [ -z "$best" ] || [ "${ns:-0}" -lt "$best_ns" ]; then
+			best="{\"program\":\"${hex%.hex}\",\"mode\":\"$mode\",\"exit\":$code,${stats#\{}"
+			best_ns=${ns:-0}
+		fi
+		i=$((i + 1))
+	done
+	printf '%s\n  %s' "$sep" "$best"
+	sep=,
+}
+
+printf '['
+sep=
+for hex in *.hex; do
+	run "$hex" trace
+	run "$hex" notrace --notrace
+	run "$hex" flight --flight 4096
+	run "$hex" compress --compress
+	run "$hex" lanes --lanes "$tmp/lanes"
+done
+printf '\n]\n'
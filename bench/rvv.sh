@@ -0,0 +1,20 @@
+#!/bin/sh
+# Times the scalar and RVV versions of each kernel in this directory.
+# usage: bench/rvv.sh [emulator]   (default: builds ../poximv2.c with -march=native)
+cd "$(dirname "$0")" || exit 1
+emu=${1:-./poximv2}
+if [ -z "$1" ]; then
+	${CC:-cc} -O2 -march=native -o "$emu" ../poximv2.c -lm -lpthread || exit 1
+fi
+
+ms() {
+	t0=$(date +%s%N)
+	"$emu" "$1" /dev/null > /dev/null
+	t1=$(date +%s%N)
+	echo $(( (t1 - t0) / 1000000 ))
+}
+
+printf "%-8s %10s %10s\n" kernel scalar_ms rvv_ms
+for k in memcpy memset dot axpy; do
+	printf "%-8s %10s %10s\n" "$k" "$(ms "$k"_scalar.hex)" "$(ms "$k"_rvv.hex)"
+done
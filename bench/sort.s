@@ -0,0 +1,47 @@
+# Insertion sort of 512 words from an lcg, 4 times. a0 counts the pairs
+# left out of order afterwards and ends 0.
+	li s0, 0x80002000	# array
+	li s1, 512
+	li s2, 4		# repetitions
+	li s4, 1		# lcg state
+	li s5, 1103515245
+	li s6, 12345
+	li a0, 0
+rep:
+	mv t0, s0		# fill
+	slli t1, s1, 2
+	add s3, s0, t1		# end
+fill:
+	mul s4, s4, s5
+	add s4, s4, s6
+	sw s4, 0(t0)
+	addi t0, t0, 4
+	bne t0, s3, fill
+	addi t0, s0, 4		# sort
+outer:
+	lw t2, 0(t0)
+	mv t1, t0
+inner:
+	beq t1, s0, place
+	lw t3, -4(t1)
+	bge t2, t3, place
+	sw t3, 0(t1)
+	addi t1, t1, -4
+	j inner
+place:
+	sw t2, 0(t1)
+	addi t0, t0, 4
+	bne t0, s3, outer
+	mv t0, s0		# check
+	addi t4, s3, -4
+check:
+	lw t2, 0(t0)
+	lw t3, 4(t0)
+	bge t3, t2, check_next
+	addi a0, a0, 1
+check_next:
+	addi t0, t0, 4
+	bne t0, t4, check
+	addi s2, s2, -1
+	bne s2, zero, rep
+	ebreak
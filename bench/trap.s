@@ -0,0 +1,31 @@
+# 32768 load faults, each one taken to mtvec, counted from mcause and mtval
+# with csrrs and returned from with mret. The count ends in a0.
+	la t0, handler
+	csrrw zero, mtvec, t0
+	li t0, 8		# mstatus.MIE and mie round trips
+	csrrs zero, mstatus, t0
+	csrrw zero, mie, t0
+	li s0, 32768
+	li s1, 0x80002000	# fault address
+	li a0, 0
+	li a1, 0
+loop:
+	la s2, resume
+	csrrw zero, mepc, s2
+	lw zero, 0(s1)		# rd = zero faults
+resume:
+	csrrs t1, mstatus, zero
+	csrrw t2, mie, t1
+	addi s0, s0, -1
+	bne s0, zero, loop
+	ebreak
+handler:
+	csrrs t0, mcause, zero
+	csrrs t1, mtval, zero
+	li t2, 2
+	bne t0, t2, unexpected
+	add a0, a0, t0
+	xor a1, a1, t1
+	mret
+unexpected:
+	ecall
@@ -1,8 +1,23 @@
+#define _GNU_SOURCE	/* fopencookie */
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <ctype.h>
 #include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <math.h>
+#include <xmmintrin.h>
+#include <emmintrin.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 #define SUCCESS 0
 #define ERROR 1
@@ -10,32 +25,183 @@
 /* 32 KiB for memory and instructions */
 #define MAX_MEMORY 32 * 1024
 
+/* vector register length in bits, 128 or 256 */
+#ifndef VLEN
+#define VLEN 256
+#endif
+#define VLENB (VLEN / 8)
+
+/* instruction handlers print their trace line only while trace is set */
+#define TRACE(...) do { if (trace) fprintf(__VA_ARGS__); } while (0)
+uint8_t trace = 1;
+uint64_t icount;	/* instructions executed */
+
+/* trace filter, checked by traced() before each instruction when filter is set */
+#define MAX_PCRANGE 16
+struct RANGE {
+	uint64_t lo;
+	uint64_t hi;	/* exclusive */
+} pcrange[MAX_PCRANGE], window = { 0, UINT64_MAX };
+uint8_t npcrange;
+uint32_t start_pc, start_store;	/* start tracing when hit, 0 for none */
+uint8_t armed = 1;	/* clear until a start condition is hit */
+uint32_t sample = 1;	/* trace every sample-th instruction */
+uint8_t filter;
+
+/* lockstep lanes, see lockstep() */
+uint32_t nlanes;
+int lane_halt = -1;	/* exit code of an ecall or ebreak while lanes run */
+
+/* --replay, see replay_init() */
+uint8_t replaying;
+uint32_t replay_pc;
+
+/* --stats, see stats_end() */
+uint64_t load_ns, run_start;
+
+/* --flight records at most, 1.25 GiB of them */
+#define MAX_FLIGHT (1u << 26)
+
 uint8_t readfile(FILE *, uint8_t *, char *, char *);
 uint8_t writefile(FILE *, uint8_t *, char *);
+uint8_t flight_init(uint32_t, FILE *);
+void flight_dump(FILE *);
+uint8_t parserange(const char *, struct RANGE *);
+FILE *check_init(const char *, char *);
+FILE *zopen(FILE *);
+uint8_t unpack(FILE *, FILE *, char *, char *);
+uint8_t lanes_init(const char *, uint8_t *, char *);
+uint8_t lockstep(FILE *, char *);
+uint32_t execute(FILE *, const uint32_t, uint8_t *, uint32_t, char *);
+FILE *heat_init(const char *, char *);
+void heat_vector(const uint32_t, const uint32_t, const uint8_t);
+uint64_t now_ns(void);
+void stats_end(void);
+FILE *rec_init(const char *, uint32_t, FILE *, char *);
+uint8_t replay_init(const char *, FILE *, uint8_t *, char *);
+void fcsr_sync(void);
+void fcsr_load(const uint16_t);
 
 int main(int argc, char *argv[])
 {
-	char *prog, *arq1, *arq2;
+	char *prog, *arq1, *arq2, *check = NULL, *lanes = NULL, *heatmap = NULL, *record = NULL, *replay = NULL;
 	FILE *input, *output;
 	uint8_t memory[MAX_MEMORY];
+	uint32_t flight = 0, every = 0;
+	uint8_t compress = 0, decompress = 0, stats = 0;
+	uint64_t t;
+	int i;
 
 	prog = argv[0]; /* program name */
-	if (argc != 3) {
-		fprintf(stderr, "Usage: %s input.hex output.out\n", prog);
+	for (i = 1; i < argc && strncmp(argv[i], "--", 2) == 0; i++) {
+		if (strcmp(argv[i], "--notrace") == 0)
+			trace = 0;
+		else if (strcmp(argv[i], "--flight") == 0 && i + 1 < argc && strtoul(argv[i+1], NULL, 0) <= MAX_FLIGHT)
+			flight = strtoul(argv[++i], NULL, 0);
+		else if (strcmp(argv[i], "--pc") == 0 && i + 1 < argc && npcrange < MAX_PCRANGE && parserange(argv[i+1], &pcrange[npcrange])) {
+			npcrange++;
+			filter = 1;
+			i++;
+		} else if (strcmp(argv[i], "--window") == 0 && i + 1 < argc && parserange(argv[i+1], &window)) {
+			filter = 1;
+			i++;
+		} else if (strcmp(argv[i], "--start-pc") == 0 && i + 1 < argc) {
+			start_pc = strtoul(argv[++i], NULL, 0);
+			armed = 0;
+			filter = 1;
+		} else if (strcmp(argv[i], "--start-store") == 0 && i + 1 < argc) {
+			start_store = strtoul(argv[++i], NULL, 0);
+			armed = 0;
+			filter = 1;
+		} else if (strcmp(argv[i], "--sample") == 0 && i + 1 < argc) {
+			sample = strtoul(argv[++i], NULL, 0);
+			filter = 1;
+		} else if (strcmp(argv[i], "--check") == 0 && i + 1 < argc)
+			check = argv[++i];
+		else if (strcmp(argv[i], "--compress") == 0)
+			compress = 1;
+		else if (strcmp(argv[i], "--decompress") == 0)
+			decompress = 1;
+		else if (strcmp(argv[i], "--lanes") == 0 && i + 1 < argc)
+			lanes = argv[++i];
+		else if (strcmp(argv[i], "--heatmap") == 0 && i + 1 < argc)
+			heatmap = argv[++i];
+		else if (strcmp(argv[i], "--stats") == 0)
+			stats = 1;
+		else if (strcmp(argv[i], "--record") == 0 && i + 2 < argc) {
+			record = argv[++i];
+			every = strtoul(argv[++i], NULL, 0);
+		} else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+			replay = argv[++i];
+		else
+			break;
+	}
+	if (argc - i != (check ? 1 : 2) || (flight && filter) || (check && (flight || !trace || compress)) || (lanes && (check || flight || filter || decompress || heatmap))
+	    || (record && (every == 0 || replay)) || ((record || replay) && (lanes || decompress)) || (replay && (check || !armed))) {
+		fprintf(stderr, "Usage: %s [options] input.hex output.out\n", prog);
+		fprintf(stderr, "       %s --check reference.out [options] input.hex\n", prog);
+		fprintf(stderr, "       %s --decompress trace.outz output.out\n", prog);
+		fprintf(stderr, "  --check REF        compare the trace with REF as it runs, stop at the first difference\n");
+		fprintf(stderr, "  --compress         write the trace compressed, read it back with --decompress\n");
+		fprintf(stderr, "  --notrace          don't write the instruction trace\n");
+		fprintf(stderr, "  --flight N         keep only the last N instructions, written on a trap, N <= %u\n", MAX_FLIGHT);
+		fprintf(stderr, "  --heatmap FILE     count fetches, loads and stores per 64 byte line, written to FILE at exit\n");
+		fprintf(stderr, "  --lanes FILE       run once per line of FILE (reg=value @addr=word) in lockstep, no trace\n");
+		fprintf(stderr, "  --record FILE N    write a checkpoint of the machine to FILE every N instructions\n");
+		fprintf(stderr, "  --replay FILE      start at the last checkpoint in FILE up to the --window start, stop at its end\n");
+		fprintf(stderr, "  --stats            print instructions, time and peak RSS as JSON on stderr at exit\n");
+		fprintf(stderr, "trace filters, not with --flight:\n");
+		fprintf(stderr, "  --pc LO:HI         only pc in [LO, HI), up to %d ranges\n", MAX_PCRANGE);
+		fprintf(stderr, "  --window N:M       only instructions N to M-1, M may be left out\n");
+		fprintf(stderr, "  --start-pc A       start when pc reaches A\n");
+		fprintf(stderr, "  --start-store A    start when a store writes address A\n");
+		fprintf(stderr, "  --sample K         every K-th instruction\n");
 		exit(10);
 	}
-	arq1 = argv[1];	/* input file name */
-	arq2 = argv[2];	/* output file name */
+	if (!trace)
+		filter = 0;
+	arq1 = argv[i];	/* input file name */
+	arq2 = argv[i+1];	/* output file name */
 	if ((input = fopen(arq1, "r")) == NULL) {
 		fprintf(stderr, "%s: can't open %s\n", prog, arq1);
 		exit(20);
 	}
-	if ((output = fopen(arq2, "w")) == NULL) {
+	if (check) {
+		if ((output = check_init(check, prog)) == NULL)
+			exit(70);
+	} else if ((output = fopen(arq2, "w")) == NULL) {
 		fprintf(stderr,  "%s: can't open %s\n", prog, arq2);
 		exit(30);
 	}
+	if (stats)
+		atexit(stats_end);	/* before all but check_end(), so it runs after the others have flushed */
+	if (decompress)
+		return unpack(input, output, prog, arq1) ? 80 : SUCCESS;
+	if (compress && (output = zopen(output)) == NULL) {
+		fprintf(stderr, "%s: can't start the compressor\n", prog);
+		exit(80);
+	}
+	t = now_ns();
 	if (readfile(input, memory, prog, arq1))
 		exit(40);
+	run_start = now_ns();
+	load_ns = run_start - t;
+	if (heatmap && heat_init(heatmap, prog) == NULL)
+		exit(30);
+	if (record && rec_init(record, every, input, prog) == NULL)
+		exit(100);
+	if (replay && replay_init(replay, input, memory, prog))
+		exit(100);
+	if (lanes) {
+		trace = 0;
+		if (lanes_init(lanes, memory, prog) || lockstep(output, prog))
+			exit(90);
+		return SUCCESS;
+	}
+	if (flight && flight_init(flight, output)) {
+		fprintf(stderr, "%s: can't allocate %u flight records\n", prog, flight);
+		exit(60);
+	}
 	if (writefile(output, memory, prog))
 		exit(50);
 	return SUCCESS;
@@ -83,44 +249,31 @@ struct CSR {
 	{ "mepc", 0 },
 	{ "mcause", 0 },
 	{ "mtval", 0 },
-	{ "mip", 80 }
+	{ "mip", 80 },
+	{ "fflags", 0 },
+	{ "frm", 0 },
+	{ "fcsr", 0 },
+	{ "vstart", 0 },
+	{ "vl", 0 },
+	{ "vtype", 0x80000000 },	/* vill until the first vsetvl */
+	{ "vlenb", VLENB }
 };
-struct REGISTERS {
-	const char *x_label;
-	uint32_t x;
-} rg[] = {
-	{ "zero", 0 },
-	{ "ra", 0 },
-	{ "sp", 0 },
-	{ "gp", 0 },
-	{ "tp", 0 },
-	{ "t0", 0 },
-	{ "t1", 0 },
-	{ "t2", 0 },
-	{ "s0", 0 },
-	{ "s1", 0 },
-	{ "a0", 0 },
-	{ "a1", 0x80200000 },
-	{ "a2", 0x00001028 },
-	{ "a3", 0 },
-	{ "a4", 0 },
-	{ "a5", 0 },
-	{ "a6", 0 },
-	{ "a7", 0 },
-	{ "s2", 0 },
-	{ "s3", 0 },
-	{ "s4", 0 },
-	{ "s5", 0 },
-	{ "s6", 0 },
-	{ "s7", 0 },
-	{ "s8", 0 },
-	{ "s9", 0 },
-	{ "s10", 0 },
-	{ "s11", 0 },
-	{ "t3", 0 },
-	{ "t4", 0 },
-	{ "t5", 0 },
-	{ "t6", 0 };
+/* fflags, frm and fcsr are views of the same register, see fcsr_sync() */
+#define CSR_FFLAGS 7
+#define CSR_FRM 8
+#define CSR_FCSR 9
+#define CSR_VSTART 10
+#define CSR_VL 11
+#define CSR_VTYPE 12
+#define CSR_VLENB 13
+/* integer registers, x[0] is cleared after every instruction */
+const char *x_label[32] = {
+	"zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2",
+	"s0", "s1", "a0", "a1", "a2", "a3", "a4", "a5",
+	"a6", "a7", "s2", "s3", "s4", "s5", "s6", "s7",
+	"s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6"
+};
+uint32_t x[32] = { [11] = 0x80200000, [12] = 0x00001028 };	/* a1, a2 */
 const uint32_t OFFSET = 0x80000000;
 
 #define GET_RD(instruction) ((instruction >> 7) & 0x1F)
@@ -131,67 +284,67 @@ const uint32_t OFFSET = 0x80000000;
 
 /* R instructions */
 void add(const uint8_t rd, const uint8_t rs1, const uint8_t rs2, uint32_t pc, FILE *output) {
-	fprintf(output, "0x%08x:add %s,%s,%s %s=0x%08x+0x%08x=0x%08x\n", pc, x_label[rd], x_label[rs1], x_label[rs2], x_label[rd], x[rs1], x[rs2], x[rs1]+x[rs2]);
+	TRACE(output, "0x%08x:add %s,%s,%s %s=0x%08x+0x%08x=0x%08x\n", pc, x_label[rd], x_label[rs1], x_label[rs2], x_label[rd], x[rs1], x[rs2], x[rs1]+x[rs2]);
 	x[rd] = x[rs1] + x[rs2];
 }
 void sub(const uint8_t rd, const uint8_t rs1, const uint8_t rs2, uint32_t pc, FILE *output) {
-	fprintf(output, "0x%08x:sub %s,%s,%s %s=0x%08x-0x%08x=0x%08x\n", pc, x_label[rd], x_label[rs1], x_label[rs2], x_label[rd], x[rs1], x[rs2], x[rs1] - x[rs2]);
+	TRACE(output, "0x%08x:sub %s,%s,%s %s=0x%08x-0x%08x=0x%08x\n", pc, x_label[rd], x_label[rs1], x_label[rs2], x_label[rd], x[rs1], x[rs2], x[rs1] - x[rs2]);
 	x[rd] = x[rs1] - x[rs2];
 }
 void xor(const uint8_t rd, const uint8_t rs1, const uint8_t rs2, uint32_t pc, FILE *output) {
-	fprintf(output, "0x%08x:xor %s,%s,%s %s=0x%08x^0x%08x=0x%08x\n", pc, x_label[rd], x_label[rs1], x_label[rs2], x_label[rd], x[rs1], x[rs2], x[rs1] ^ x[rs2]);
+	TRACE(output, "0x%08x:xor %s,%s,%s %s=0x%08x^0x%08x=0x%08x\n", pc, x_label[rd], x_label[rs1], x_label[rs2], x_label[rd], x[rs1], x[rs2], x[rs1] ^ x[rs2]);
 	x[rd] = x[rs1] ^ x[rs2];
 }
 void or(const uint8_t rd, const uint8_t rs1, const uint8_t rs2, uint32_t pc, FILE *output) {
-	fprintf(output, "0x%08x:or  %s,%s,%s %s=0x%08x|0x%08x=0x%08x\n", pc, x_label[rd], x_label[rs1], x_label[rs2], x_label[rd], x[rs1], x[rs2], x[rs1] | x[rs2]);
+	TRACE(output, "0x%08x:or  %s,%s,%s %s=0x%08x|0x%08x=0x%08x\n", pc, x_label[rd], x_label[rs1], x_label[rs2], x_label[rd], x[rs1], x[rs2], x[rs1] | x[rs2]);
 	x[rd] = x[rs1] | x[rs2];
 }
 void and(const uint8_t rd, const uint8_t rs1, const uint8_t rs2, uint32_t pc, FILE *output) {
-	fprintf(output, "0x%08x:and %s,%s,%s %s=0x%08x&0x%08x=0x%08x\n", pc, x_label[rd], x_label[rs1], x_label[rs2], x_label[rd], x[rs1], x[rs2],  x[rs1] & x[rs2]);
+	TRACE(output, "0x%08x:and %s,%s,%s %s=0x%08x&0x%08x=0x%08x\n", pc, x_label[rd], x_label[rs1], x_label[rs2], x_label[rd], x[rs1], x[rs2],  x[rs1] & x[rs2]);
 	x[rd] = x[rs1] & x[rs2];
 }
 void sll(const uint8_t rd, const uint8_t rs1, const uint8_t rs2, uint32_t pc, FILE *output) {
-	fprintf(output, "0x%08x:sll %s,%s,%s %s=0x%08x<<%d=0x%08x\n", pc, x_label[rd], x_label[rs1], x_label[rs2], x_label[rd], x[rs1], x[rs2] & 0x1F, x[rs1] << x[rs2]);
+	TRACE(output, "0x%08x:sll %s,%s,%s %s=0x%08x<<%d=0x%08x\n", pc, x_label[rd], x_label[rs1], x_label[rs2], x_label[rd], x[rs1], x[rs2] & 0x1F, x[rs1] << x[rs2]);
 	x[rd] = x[rs1] << x[rs2];
 }
 void srl(const uint8_t rd, const uint8_t rs1, const uint8_t rs2, uint32_t pc, FILE *output) {
-	fprintf(output, "0x%08x:srl %s,%s,%s %s=0x%08x>>%u=0x%08x\n", pc, x_label[rd], x_label[rs1], x_label[rs2], x_label[rd], x[rs1], x[rs2] & 0x1f, x[rs1] >> x[rs2]);
+	TRACE(output, "0x%08x:srl %s,%s,%s %s=0x%08x>>%u=0x%08x\n", pc, x_label[rd], x_label[rs1], x_label[rs2], x_label[rd], x[rs1], x[rs2] & 0x1f, x[rs1] >> x[rs2]);
 	x[rd] = x[rs1] >> x[rs2];
 }
 void sra(const uint8_t rd, const uint8_t rs1, const uint8_t rs2, uint32_t pc, FILE *output) {
-	fprintf(output, "0x%08x:sra %s,%s,%s %s=0x%08x>>>%u=0x%08x\n", pc, x_label[rd], x_label[rs1], x_label[rs2], x_label[rd], x[rs1], x[rs2] & 0x1f, (int32_t)x[rs1] >> x[rs2]);
+	TRACE(output, "0x%08x:sra %s,%s,%s %s=0x%08x>>>%u=0x%08x\n", pc, x_label[rd], x_label[rs1], x_label[rs2], x_label[rd], x[rs1], x[rs2] & 0x1f, (int32_t)x[rs1] >> x[rs2]);
 	x[rd] = (int32_t)x[rs1] >> x[rs2];
 }
 void slt(const uint8_t rd, const uint8_t rs1, const uint8_t rs2, uint32_t pc, FILE *output) {
-	fprintf(output, "0x%08x:slt %s,%s,%s %s=(0x%08x<0x%08x)=%u\n", pc, x_label[rd], x_label[rs1], x_label[rs2], x_label[rd], x[rs1], x[rs2], ((int32_t)x[rs1]) < ((int32_t)x[rs2]) ? 1 : 0);
+	TRACE(output, "0x%08x:slt %s,%s,%s %s=(0x%08x<0x%08x)=%u\n", pc, x_label[rd], x_label[rs1], x_label[rs2], x_label[rd], x[rs1], x[rs2], ((int32_t)x[rs1]) < ((int32_t)x[rs2]) ? 1 : 0);
 	x[rd] = ((int32_t)x[rs1]) < ((int32_t)x[rs2]) ? 1 : 0;
 }
 void sltu(const uint8_t rd, const uint8_t rs1, const uint8_t rs2, uint32_t pc, FILE *output) {
-	fprintf(output, "0x%08x:sltu %s,%s,%s %s=(0x%08x<0x%08x)=%u\n", pc, x_label[rd], x_label[rs1], x_label[rs2], x_label[rd], x[rs1], x[rs2], (x[rs1] < x[rs2]) ? 1 : 0);
+	TRACE(output, "0x%08x:sltu %s,%s,%s %s=(0x%08x<0x%08x)=%u\n", pc, x_label[rd], x_label[rs1], x_label[rs2], x_label[rd], x[rs1], x[rs2], (x[rs1] < x[rs2]) ? 1 : 0);
 	x[rd] = (x[rs1] < x[rs2]) ? 1 : 0;
 }
 
 void mul(uint8_t rd, uint8_t rs1, uint8_t rs2, uint32_t pc, FILE *output)
 {
-	fprintf(output, "0x%08x:mul %s,%s,%s %s=0x%08x*0x%08x=0x%08x\n", pc, x_label[rd], x_label[rs1], x_label[rs2], x_label[rd], x[rs1], x[rs2], (x[rs1] * x[rs2]) & 0xFFFFFFFF);
+	TRACE(output, "0x%08x:mul %s,%s,%s %s=0x%08x*0x%08x=0x%08x\n", pc, x_label[rd], x_label[rs1], x_label[rs2], x_label[rd], x[rs1], x[rs2], (x[rs1] * x[rs2]) & 0xFFFFFFFF);
 	x[rd] = (x[rs1] * x[rs2]) & 0xFFFFFFFF;
 }
 void mulh(uint8_t rd, uint8_t rs1, uint8_t rs2, uint32_t pc, FILE *output)
 {
 	int64_t result = ((int64_t)(int32_t)x[rs1]) * ((int64_t)(int32_t)x[rs2]);
-	fprintf(output, "0x%08x:mulh %s,%s,%s %s=0x%08x*0x%08x=0x%08x\n", pc, x_label[rd], x_label[rs1], x_label[rs2], x_label[rd], x[rs1], x[rs2], (int32_t)result >> 32);
+	TRACE(output, "0x%08x:mulh %s,%s,%s %s=0x%08x*0x%08x=0x%08x\n", pc, x_label[rd], x_label[rs1], x_label[rs2], x_label[rd], x[rs1], x[rs2], (int32_t)(result >> 32));
 	x[rd] = (int32_t)(result >> 32);
 }
 void mulsu(uint8_t rd, uint8_t rs1, uint8_t rs2, uint32_t pc, FILE *output)
 {
 	int64_t result = ((int64_t)(int32_t)x[rs1]) * ((uint64_t)x[rs2]);
-	fprintf(output, "0x%08x:mulhsu %s,%s,%s %s=0x%08x*0x%08x=0x%08x\n", pc, x_label[rd], x_label[rs1], x_label[rs2], x_label[rd], x[rs1], x[rs2], (int32_t)(result >> 32));
+	TRACE(output, "0x%08x:mulhsu %s,%s,%s %s=0x%08x*0x%08x=0x%08x\n", pc, x_label[rd], x_label[rs1], x_label[rs2], x_label[rd], x[rs1], x[rs2], (int32_t)(result >> 32));
 	x[rd] = (int32_t)(result >> 32);
 }
 void mulu(uint8_t rd, uint8_t rs1, uint8_t rs2, uint32_t pc, FILE *output)
 {
 	int64_t result = (((uint64_t)(x[rs1])) * ((uint64_t)(x[rs2]))) >> 32;
-	fprintf(output, "0x%08x:mulhu %s,%s,%s %s=0x%08x*0x%08x=0x%08x\n", pc, x_label[rd], x_label[rs1], x_label[rs2], x_label[rd], x[rs1], x[rs2], result & 0xFFFFFFFF);
+	TRACE(output, "0x%08x:mulhu %s,%s,%s %s=0x%08x*0x%08x=0x%08x\n", pc, x_label[rd], x_label[rs1], x_label[rs2], x_label[rd], x[rs1], x[rs2], (uint32_t)result);
 	x[rd] = result & 0xFFFFFFFF;
 }
 void divr(uint8_t rd, uint8_t rs1, uint8_t rs2, uint32_t pc, FILE *output)
@@ -200,7 +353,7 @@ void divr(uint8_t rd, uint8_t rs1, uint8_t rs2, uint32_t pc, FILE *output)
 		result = (((int32_t)x[rs1]) / ((int32_t)x[rs2]));
 	else
 		result = 0xFFFFFFFF;
-	fprintf(output, "0x%08x:div %s,%s,%s %s=0x%08x/0x%08x=0x%08x\n", pc, x_label[rd], x_label[rs1], x_label[rs2], x_label[rd], x[rs1], x[rs2], result);
+	TRACE(output, "0x%08x:div %s,%s,%s %s=0x%08x/0x%08x=0x%08x\n", pc, x_label[rd], x_label[rs1], x_label[rs2], x_label[rd], x[rs1], x[rs2], result);
 	x[rd] = result;
 }
 void divu(uint8_t rd, uint8_t rs1, uint8_t rs2, uint32_t pc, FILE *output)
@@ -210,27 +363,27 @@ void divu(uint8_t rd, uint8_t rs1, uint8_t rs2, uint32_t pc, FILE *output)
 		result = x[rs1] / (x[rs2]);
 	else
 		result = 0xFFFFFFFF;
-	fprintf(output, "0x%08x:divu %s,%s,%s %s=0x%08x/0x%08x=0x%08x\n", pc, x_label[rd], x_label[rs1], x_label[rs2], x_label[rd], x[rs1], x[rs2], result);
+	TRACE(output, "0x%08x:divu %s,%s,%s %s=0x%08x/0x%08x=0x%08x\n", pc, x_label[rd], x_label[rs1], x_label[rs2], x_label[rd], x[rs1], x[rs2], result);
 	x[rd] = result;
 }
 void rem(uint8_t rd, uint8_t rs1, uint8_t rs2, uint32_t pc, FILE *output)
 {
-	int32_t result
+	int32_t result;
 	if (x[rs2] != 0)
 		result = ((int32_t)x[rs1]) % ((int32_t)x[rs2]);
 	else
 		result = x[rs1];
-	fprintf(output, "0x%08x:rem %s,%s,%s %s=0x%08x%%0x%08x=0x%08x\n", pc, x_label[rd], x_label[rs1], x_label[rs2], x_label[rd], x[rs1], x[rs2], result);
+	TRACE(output, "0x%08x:rem %s,%s,%s %s=0x%08x%%0x%08x=0x%08x\n", pc, x_label[rd], x_label[rs1], x_label[rs2], x_label[rd], x[rs1], x[rs2], result);
 	x[rd] = result;
 }
 void remu(uint8_t rd, uint8_t rs1, uint8_t rs2, uint32_t pc, FILE *output)
 {
-	int32_t result
+	int32_t result;
 	if (x[rs2] != 0)
 		result = x[rs1] % x[rs2];
 	else
 		result = x[rs1];
-	fprintf(output, "0x%08x:remu %s,%s,%s %s=0x%08x%%0x%08x=0x%08x\n", pc, x_label[rd], x_label[rs1], x_label[rs2], x_label[rd], x[rs1], x[rs2], result);
+	TRACE(output, "0x%08x:remu %s,%s,%s %s=0x%08x%%0x%08x=0x%08x\n", pc, x_label[rd], x_label[rs1], x_label[rs2], x_label[rd], x[rs1], x[rs2], result);
 	x[rd] = result;
 }
 
@@ -340,39 +493,39 @@ void R(FILE *output, const uint32_t instruction, uint8_t memory[], uint32_t pc,
 }
 
 void addi(FILE *output, const uint8_t rd, const uint8_t rs1, const int32_t simm, uint32_t pc) {
-	fprintf(output, "0x%08x:addi %s,%s,0x%03x %s=0x%08x+0x%08x=0x%08x\n", pc, x_label[rd], x_label[rs1], simm & 0xFFF, x_label[rd], x[rs1], simm, x[rs1] + simm);
+	TRACE(output, "0x%08x:addi %s,%s,0x%03x %s=0x%08x+0x%08x=0x%08x\n", pc, x_label[rd], x_label[rs1], simm & 0xFFF, x_label[rd], x[rs1], simm, x[rs1] + simm);
 	x[rd] = x[rs1] + simm;
 }
 void xori(FILE *output, const uint8_t rd, const uint8_t rs1, const int32_t simm, uint32_t pc) {
-	fprintf(output, "0x%08x:xori %s,%s,0x%03x %s=0x%08x^0x%08x=0x%08x\n", pc, x_label[rd], x_label[rs1], simm & 0xFFF, x_label[rd], x[rs1], simm, x[rs1] ^ simm);
+	TRACE(output, "0x%08x:xori %s,%s,0x%03x %s=0x%08x^0x%08x=0x%08x\n", pc, x_label[rd], x_label[rs1], simm & 0xFFF, x_label[rd], x[rs1], simm, x[rs1] ^ simm);
 	x[rd] = x[rs1] ^ simm;
 }
 void ori(FILE *output, const uint8_t rd, const uint8_t rs1, const int32_t simm, uint32_t pc) {
-	fprintf(output, "0x%08x:ori %s,%s,0x%03x %s=0x%08x|0x%08x=0x%08x\n", pc, x_label[rd], x_label[rs1], simm & 0xFFF, x_label[rd], x[rs1], simm, x[rs1] | simm);
+	TRACE(output, "0x%08x:ori %s,%s,0x%03x %s=0x%08x|0x%08x=0x%08x\n", pc, x_label[rd], x_label[rs1], simm & 0xFFF, x_label[rd], x[rs1], simm, x[rs1] | simm);
 	x[rd] = x[rs1] | simm;
 }
 void andi(FILE *output, const uint8_t rd, const uint8_t rs1, const int32_t simm, uint32_t pc) {
-	fprintf(output, "0x%08x:andi %s,%s,0x%03x %s=0x%08x&0x%08x=0x%08x\n", pc, x_label[rd], x_label[rs1], simm & 0xFFF, x_label[rd], x[rs1], simm, x[rs1] & simm);
+	TRACE(output, "0x%08x:andi %s,%s,0x%03x %s=0x%08x&0x%08x=0x%08x\n", pc, x_label[rd], x_label[rs1], simm & 0xFFF, x_label[rd], x[rs1], simm, x[rs1] & simm);
 	x[rd] = x[rs1] & simm;
 }
 void slli(FILE *output, const uint8_t rd, const uint8_t rs1, const int8_t imm5, uint32_t pc) {
-	fprintf(output, "0x%08x:slli %s,%s,%u %s=0x%08x<<%u=0x%08x\n", pc, x_label[rd], x_label[rs1], imm5, x_label[rd], x[rs1], imm5, x[rs1] << imm5);
+	TRACE(output, "0x%08x:slli %s,%s,%u %s=0x%08x<<%u=0x%08x\n", pc, x_label[rd], x_label[rs1], imm5, x_label[rd], x[rs1], imm5, x[rs1] << imm5);
 	x[rd] = x[rs1] << imm5;
 }
 void srli(FILE *output, const uint8_t rd, const uint8_t rs1, const int8_t imm5, uint32_t pc) {
-	fprintf(output, "0x%08x:srli %s,%s,%u %s=0x%08x>>%u=0x%08x\n", pc, x_label[rd], x_label[rs1], imm5, x_label[rd], x[rs1], imm5, x[rs1] >> imm5);
+	TRACE(output, "0x%08x:srli %s,%s,%u %s=0x%08x>>%u=0x%08x\n", pc, x_label[rd], x_label[rs1], imm5, x_label[rd], x[rs1], imm5, x[rs1] >> imm5);
 	x[rd] = x[rs1] >> imm5;
 }
 void srai(FILE *output, const uint8_t rd, const uint8_t rs1, const int8_t imm5, uint32_t pc) {
-	fprintf(output, "0x%08x:srai %s,%s,%u %s=0x%08x>>>%u=0x%08x\n", pc, x_label[rd], x_label[rs1], imm5, x_label[rd], x[rs1], imm5, (int32_t)x[rs1] >> imm5);
+	TRACE(output, "0x%08x:srai %s,%s,%u %s=0x%08x>>>%u=0x%08x\n", pc, x_label[rd], x_label[rs1], imm5, x_label[rd], x[rs1], imm5, (int32_t)x[rs1] >> imm5);
 	x[rd] = (int32_t)x[rs1] >> imm5;
 }
 void slti(FILE *output, const uint8_t rd, const uint8_t rs1, const int32_t simm, uint32_t pc) {
-	fprintf(output, "0x%08x:slti %s,%s,0x%03x %s=(0x%08x<0x%08x)=u\n", pc, x_label[rd], x_label[rs1], simm & 0xFFF, x_label[rd], x[rs1], simm, ((int32_t)x[rs1]) < ((int32_t)simm) ? 1 : 0);
+	TRACE(output, "0x%08x:slti %s,%s,0x%03x %s=(0x%08x<0x%08x)=%u\n", pc, x_label[rd], x_label[rs1], simm & 0xFFF, x_label[rd], x[rs1], simm, ((int32_t)x[rs1]) < ((int32_t)simm) ? 1 : 0);
 	x[rd] = ((int32_t)x[rs1]) < ((int32_t)simm) ? 1 : 0;
 }
 void sltiu(FILE *output, const uint8_t rd, const uint8_t rs1, const int32_t simm, uint32_t pc) {
-	fprintf(output, "0x%08x:sltiu %s,%s,0x%03x %s=(0x%08x<0x%08x)=%u\n", pc, x_label[rd], x_label[rs1], simm & 0xFFF, x_label[rd], x[rs1], simm, x[rs1] < ((uint32_t)simm) ? 1 : 0);
+	TRACE(output, "0x%08x:sltiu %s,%s,0x%03x %s=(0x%08x<0x%08x)=%u\n", pc, x_label[rd], x_label[rs1], simm & 0xFFF, x_label[rd], x[rs1], simm, x[rs1] < ((uint32_t)simm) ? 1 : 0);
 	x[rd] = x[rs1] < ((uint32_t)simm) ? 1 : 0;
 }
 
@@ -427,14 +580,14 @@ void lb(FILE *output, uint8_t memory[], const uint8_t rd, const uint8_t rs1, con
 	uint16_t posi = x[rs1]+simm-OFFSET;
 	if (posi < MAX_MEMORY && posi >= 0) {
 		x[rd] = (int8_t)(memory[posi]);
-		fprintf(output, "0x%08x:lb %s,0x%03x(%s) %s=mem[0x%08x]=0x%08x\n", pc, x_label[rd], simm, x_label[rs1], x_label[rd], posi+OFFSET, x[rd]);
+		TRACE(output, "0x%08x:lb %s,0x%03x(%s) %s=mem[0x%08x]=0x%08x\n", pc, x_label[rd], simm, x_label[rs1], x_label[rd], posi+OFFSET, x[rd]);
 	} else printf("lb out of memory\n");
 }
 void lh(FILE *output, uint8_t memory[], const uint8_t rd, const uint8_t rs1, const int32_t simm, uint32_t pc) {
 	uint16_t posi = x[rs1]+simm-OFFSET;
 	if (posi < MAX_MEMORY-2 && posi >= 0) {
 		x[rd] = ((int16_t *)(memory+posi))[0];
-		fprintf(output, "0x%08x:lh	%s,0x%03x(%s)	%s=mem[0x%08x]=0x%08x\n", pc, x_label[rd], simm, x_label[rs1], x_label[rd], posi+OFFSET, x[rd]);
+		TRACE(output, "0x%08x:lh	%s,0x%03x(%s)	%s=mem[0x%08x]=0x%08x\n", pc, x_label[rd], simm, x_label[rs1], x_label[rd], posi+OFFSET, x[rd]);
 	} else printf("lh out of memory\n");
 }
 void lw(FILE *output, uint8_t memory[], const uint8_t rd, const uint8_t rs1, const int32_t simm, uint32_t pc) {
@@ -443,21 +596,21 @@ void lw(FILE *output, uint8_t memory[], const uint8_t rd, const uint8_t rs1, con
 		printf("achei borra\n");
 	if (posi < MAX_MEMORY-4 && posi >= 0) {
 		x[rd] = ((int32_t *)(memory+posi))[0];
-		fprintf(output, "0x%08x:lw %s,0x%03x(%s) %s=mem[0x%08x]=0x%08x\n", pc, x_label[rd], simm & 0xFFF, x_label[rs1], x_label[rd], posi+OFFSET, x[rd]);
+		TRACE(output, "0x%08x:lw %s,0x%03x(%s) %s=mem[0x%08x]=0x%08x\n", pc, x_label[rd], simm & 0xFFF, x_label[rs1], x_label[rd], posi+OFFSET, x[rd]);
 	} else printf("lw out of memory\n");
 }
 void lbu(FILE *output, uint8_t memory[], const uint8_t rd, const uint8_t rs1, const int32_t simm, uint32_t pc) {
 	uint16_t posi = x[rs1]+simm-OFFSET;
 	if (posi < MAX_MEMORY && posi >= 0) {
 		x[rd] = memory[posi] & 0xFF;
-		fprintf(output, "0x%08x:lbu %s,0x%03x(%s) %s=mem[0x%08x]=0x%08x\n", pc, x_label[rd], simm, x_label[rs1], x_label[rd], posi+OFFSET, x[rd]);
+		TRACE(output, "0x%08x:lbu %s,0x%03x(%s) %s=mem[0x%08x]=0x%08x\n", pc, x_label[rd], simm, x_label[rs1], x_label[rd], posi+OFFSET, x[rd]);
 	} else printf("lbu out of memory\n");
 }
 void lhu(FILE *output, uint8_t memory[], const uint8_t rd, const uint8_t rs1, const int32_t simm, uint32_t pc) {
 	uint16_t posi = x[rs1]+simm-OFFSET;
 	if (posi < MAX_MEMORY-2 && posi >= 0) { 
 		x[rd] = (uint32_t)(((uint16_t *)(memory+posi))[0]);
-		fprintf(output, "0x%08x:lhu	%s,0x%03x(%s)	%s=mem[0x%08x]=0x%08x\n", pc, x_label[rd], simm, x_label[rs1], x_label[rd], posi+OFFSET, x[rd]);
+		TRACE(output, "0x%08x:lhu	%s,0x%03x(%s)	%s=mem[0x%08x]=0x%08x\n", pc, x_label[rd], simm, x_label[rs1], x_label[rd], posi+OFFSET, x[rd]);
 	} else printf("lhu out of memory\n");
 }
 void Iload(FILE *output, const uint32_t instruction, const uint8_t funct3, uint8_t memory[], const uint8_t rd, const uint8_t rs1, const int16_t imm, uint32_t *pc, char *prog)
@@ -470,6 +623,7 @@ void Iload(FILE *output, const uint32_t instruction, const uint8_t funct3, uint8
 			csr[4].x = 0x2;
 			// *pc = mtvec
 			*pc = csr[2].x - 4;
+			flight_dump(output);
 			fprintf(output, ">exception:illegal_instruction cause=0x%08x,epc=0x%08x,tval=0x%08x\n", csr[4].x, csr[3].x, csr[5].x);
 			//tval = imm
 			csr[5].x = simm;
@@ -482,6 +636,7 @@ void Iload(FILE *output, const uint32_t instruction, const uint8_t funct3, uint8
 			csr[4].x = 0x2;
 			// *pc = mtvec
 			*pc = csr[2].x - 4;
+			flight_dump(output);
 			fprintf(output, ">exception:load_fault cause=0x%08x,epc=0x%08x,tval=0x%08x\n", csr[4].x, csr[3].x, csr[5].x);
 			//tval = imm
 			csr[5].x = simm;
@@ -511,9 +666,9 @@ void Iload(FILE *output, const uint32_t instruction, const uint8_t funct3, uint8
 
 void jarl(FILE *output, const uint8_t rd, const uint8_t rs1, const int32_t simm, uint32_t *pc) {
 	uint32_t aux = x[rs1];
-	fprintf(output, "0x%08x:jalr %s,%s,0x%03x pc=0x%08x+0x%08x,%s=0x%08x\n", *pc, x_label[rd], x_label[rs1], simm, x[rs1], simm, x_label[rd], *pc+4);
+	TRACE(output, "0x%08x:jalr %s,%s,0x%03x pc=0x%08x+0x%08x,%s=0x%08x\n", *pc, x_label[rd], x_label[rs1], simm, x[rs1], simm, x_label[rd], *pc+4);
 	x[rd] = *pc + 4;
-	*pc = x[rs1] + simm;
+	*pc = aux + simm;
 	*pc -= 4;
 }
 void Ijump(FILE *output, const uint32_t instruction, const uint8_t funct3, const uint8_t rd, const uint8_t rs1, const int16_t imm, uint32_t *pc, char *prog)
@@ -526,12 +681,20 @@ void Ijump(FILE *output, const uint32_t instruction, const uint8_t funct3, const
 		fprintf(stderr, "%s: unknwon instruction %x\n", prog, instruction);
 }
 void ecall(FILE *output, uint32_t pc) {
-	fprintf(output, "0x%08x:ecall\n", pc);
-	exit(11);
+	flight_dump(output);
+	TRACE(output, "0x%08x:ecall\n", pc);
+	if (nlanes)
+		lane_halt = 11;
+	else
+		exit(11);
 }
 void ebreak(FILE *output, uint32_t pc) {
-	fprintf(output, "0x%08x:ebreak\n", pc);
-	exit(0);
+	flight_dump(output);
+	TRACE(output, "0x%08x:ebreak\n", pc);
+	if (nlanes)
+		lane_halt = 0;
+	else
+		exit(0);
 }
 uint16_t getcsr(uint16_t csr_index)
 {
@@ -550,6 +713,20 @@ uint16_t getcsr(uint16_t csr_index)
 			return 5;
 		case 0x344:
 			return 6;
+		case 0x001:
+			return CSR_FFLAGS;
+		case 0x002:
+			return CSR_FRM;
+		case 0x003:
+			return CSR_FCSR;
+		case 0x008:
+			return CSR_VSTART;
+		case 0xC20:
+			return CSR_VL;
+		case 0xC21:
+			return CSR_VTYPE;
+		case 0xC22:
+			return CSR_VLENB;
 		default:
 			return -1;
 	}
@@ -557,20 +734,20 @@ uint16_t getcsr(uint16_t csr_index)
 void csrrw(FILE *output, const uint8_t rd, const uint8_t rs1, uint16_t c, uint32_t pc)
 {
 	uint32_t aux = x[rs1];
-	fprintf(output, "0x%08x:csrrw %s,%s,%s %s=%s=0x%08x,%s=%s=0x%08x\n", pc, x_label[rd], csr[c].x_label, x_label[rs1], x_label[rd], csr[c].x_label, csr[c].x, csr[c].x_label, x_label[rs1], x[rs1]);
+	TRACE(output, "0x%08x:csrrw %s,%s,%s %s=%s=0x%08x,%s=%s=0x%08x\n", pc, x_label[rd], csr[c].x_label, x_label[rs1], x_label[rd], csr[c].x_label, csr[c].x, csr[c].x_label, x_label[rs1], x[rs1]);
 	x[rd] = csr[c].x;
 	csr[c].x = aux;
 }
 void csrrs(FILE *output, const uint8_t rd, const uint8_t rs1, uint16_t c, uint32_t pc)
 {
 	uint32_t aux = x[rs1];
-	fprintf(output, "0x%08x:csrrs %s,%s,%s %s=%s=0x%08x,%s|=%s=0x%08x|0x%08x=0x%08x\n", pc, x_label[rd], csr[c].x_label, x_label[rs1], x_label[rd], csr[c].x_label, csr[c].x, csr[c].x_label, x_label[rs1], csr[c].x, aux, csr[c].x | aux);
+	TRACE(output, "0x%08x:csrrs %s,%s,%s %s=%s=0x%08x,%s|=%s=0x%08x|0x%08x=0x%08x\n", pc, x_label[rd], csr[c].x_label, x_label[rs1], x_label[rd], csr[c].x_label, csr[c].x, csr[c].x_label, x_label[rs1], csr[c].x, aux, csr[c].x | aux);
 	x[rd] = csr[c].x;
 	csr[c].x = csr[c].x | aux;
 }
 void mret(FILE *output, uint32_t *pc)
 {
-	fprintf(output, "0x%08x:mret pc=0x%08x\n", *pc ,csr[3].x);
+	TRACE(output, "0x%08x:mret pc=0x%08x\n", *pc ,csr[3].x);
 	csr[0].x = 0x00000080;
 	*pc = csr[3].x-4;
 
@@ -585,7 +762,21 @@ void Icsr(FILE *output, const uint32_t instruction, const uint8_t funct3, const
 		ebreak(output, *pc);
 	else if (imm == 0b001100000010 && funct3 == 0 && rd == 0 && rs1 == 0)
 		mret(output, pc);
-	else
+	else if ((c == CSR_VL || c == CSR_VTYPE || c == CSR_VLENB) && (funct3 == 0x1 || funct3 == 0x5 || rs1 != 0)) {
+			//vl, vtype and vlenb are read only, vsetvl* sets the first two
+			//mstatus
+			csr[0].x = 0x00001800;
+			//mcause
+			csr[4].x = 0x2;
+			// *pc = mtvec
+			*pc = csr[2].x - 4;
+			flight_dump(output);
+			fprintf(output, ">exception:illegal_instruction cause=0x%08x,epc=0x%08x,tval=0x%08x\n", csr[4].x, csr[3].x, csr[5].x);
+			//tval = instruction
+			csr[5].x = instruction;
+	} else {
+		if (c >= CSR_FFLAGS && c <= CSR_FCSR)
+			fcsr_sync();
 		switch (funct3) {
 			case 0x1:
 				csrrw(output, rd, rs1, c, *pc);
@@ -606,6 +797,9 @@ void Icsr(FILE *output, const uint32_t instruction, const uint8_t funct3, const
 			default:
 				fprintf(stderr, "%s: unknwon instruction %x\n", prog, instruction);
 		}
+		if (c >= CSR_FFLAGS && c <= CSR_FCSR)
+			fcsr_load(c);
+	}
 }
 
 void I(FILE *output, const uint32_t instruction, uint8_t memory[], uint32_t *pc, char *prog, const uint8_t opcode)
@@ -634,19 +828,19 @@ void I(FILE *output, const uint32_t instruction, uint8_t memory[], uint32_t *pc,
 void sb(FILE *output, const uint8_t rs1, const uint8_t rs2, const int32_t simm, uint8_t memory[], uint32_t pc) {
 	uint16_t posi = x[rs1]+simm-OFFSET;
 	memory[posi] = x[rs2] & 0xFF;
-	fprintf(output, "0x%08x:sb %s,0x%03x(%s) mem[0x%08x]=0x%02x\n", pc, x_label[rs2], simm & 0xFFF, x_label[rs1], posi+OFFSET, memory[posi] & 0xFF);
+	TRACE(output, "0x%08x:sb %s,0x%03x(%s) mem[0x%08x]=0x%02x\n", pc, x_label[rs2], simm & 0xFFF, x_label[rs1], posi+OFFSET, memory[posi] & 0xFF);
 }
 void sh(FILE *output, const uint8_t rs1, const uint8_t rs2, const int32_t simm, uint8_t memory[], uint32_t pc) {
 	uint16_t posi = x[rs1]+simm-OFFSET;
 	uint16_t *mem = ((uint16_t *)(memory+posi));
 	*mem = x[rs2] & 0xFFFF;
-	fprintf(output, "0x%08x:sh %s,0x%03x(%s) mem[0x%08x]=0x%04x\n", pc, x_label[rs2], simm & 0xFFF, x_label[rs1], posi+OFFSET, *mem & 0xFFFF);
+	TRACE(output, "0x%08x:sh %s,0x%03x(%s) mem[0x%08x]=0x%04x\n", pc, x_label[rs2], simm & 0xFFF, x_label[rs1], posi+OFFSET, *mem & 0xFFFF);
 }
 void sw(FILE *output, const uint8_t rs1, const uint8_t rs2, const int32_t simm, uint8_t memory[], uint32_t pc) {
 	uint16_t posi = x[rs1]+simm-OFFSET;
 	uint32_t *mem = ((uint32_t *)(memory+posi));
 	*mem = x[rs2];
-	fprintf(output, "0x%08x:sw %s,0x%03x(%s) mem[0x%08x]=0x%08x\n", pc, x_label[rs2], simm & 0xFFF, x_label[rs1], posi+OFFSET, *mem);
+	TRACE(output, "0x%08x:sw %s,0x%03x(%s) mem[0x%08x]=0x%08x\n", pc, x_label[rs2], simm & 0xFFF, x_label[rs1], posi+OFFSET, *mem);
 }
 
 void S(FILE *output, const uint32_t instruction, uint8_t memory[], uint32_t pc, char *prog)
@@ -666,6 +860,7 @@ void S(FILE *output, const uint32_t instruction, uint8_t memory[], uint32_t pc,
 			csr[4].x = 0x5;
 			// pc = mtvec
 			pc = csr[2].x - 4;
+			flight_dump(output);
 			fprintf(output, ">exception:store_fault cause=0x%08x,epc=0x%08x,tval=0x%08x\n", csr[4].x, csr[3].x, csr[5].x);
 			//tval = instruction
 			csr[5].x = simm;
@@ -680,6 +875,7 @@ void S(FILE *output, const uint32_t instruction, uint8_t memory[], uint32_t pc,
 			csr[4].x = 0x5;
 			// pc = mtvec
 			pc = csr[2].x - 4;
+			flight_dump(output);
 			fprintf(output, ">exception:store_fault cause=0x%08x,epc=0x%08x,tval=0x%08x\n", csr[4].x, csr[3].x, csr[5].x);
 			//tval = instruction
 			csr[5].x = simm;
@@ -694,6 +890,7 @@ void S(FILE *output, const uint32_t instruction, uint8_t memory[], uint32_t pc,
 			csr[4].x = 0x5;
 			// pc = mtvec
 			pc = csr[2].x - 4;
+			flight_dump(output);
 			fprintf(output, ">exception:store_fault cause=0x%08x,epc=0x%08x,tval=0x%08x\n", csr[4].x, csr[3].x, csr[5].x);
 			//tval = instruction
 			csr[5].x = simm;
@@ -712,7 +909,7 @@ void beq(FILE *output, const uint8_t rs1, const uint8_t rs2, const int32_t simm,
 		*pc += simm << 1;
 	else
 		*pc += 4;
-	fprintf(output, "0x%08x:beq %s,%s,0x%03x (0x%08x==0x%08x)=%d->pc=0x%08x\n", instAdress, x_label[rs1], x_label[rs2], simm, x[rs1], x[rs2], x[rs1]==x[rs2], *pc);
+	TRACE(output, "0x%08x:beq %s,%s,0x%03x (0x%08x==0x%08x)=%d->pc=0x%08x\n", instAdress, x_label[rs1], x_label[rs2], simm, x[rs1], x[rs2], x[rs1]==x[rs2], *pc);
 	*pc -= 4;
 }
 void bne(FILE *output, const uint8_t rs1, const uint8_t rs2, const int32_t simm, uint32_t *pc)
@@ -722,7 +919,7 @@ void bne(FILE *output, const uint8_t rs1, const uint8_t rs2, const int32_t simm,
 		*pc += simm << 1;
 	else
 		*pc += 4;
-	fprintf(output, "0x%08x:bne %s,%s,0x%03x (0x%08x!=0x%08x)=%d->pc=0x%08x\n", instAdress, x_label[rs1], x_label[rs2], simm & 0xFFF, x[rs1], x[rs2], x[rs1]!=x[rs2], *pc);
+	TRACE(output, "0x%08x:bne %s,%s,0x%03x (0x%08x!=0x%08x)=%d->pc=0x%08x\n", instAdress, x_label[rs1], x_label[rs2], simm & 0xFFF, x[rs1], x[rs2], x[rs1]!=x[rs2], *pc);
 	*pc -= 4;
 }
 void blt(FILE *output, const uint8_t rs1, const uint8_t rs2, const int32_t simm, uint32_t *pc)
@@ -732,7 +929,7 @@ void blt(FILE *output, const uint8_t rs1, const uint8_t rs2, const int32_t simm,
 		*pc += simm << 1;
 	else
 		*pc += 4;
-	fprintf(output, "0x%08x:blt %s,%s,0x%03x (0x%08x<0x%08x)=%d->pc=0x%08x\n", instAdress, x_label[rs1], x_label[rs2], (simm & 0xFFF), x[rs1], x[rs2], (int32_t)x[rs1]<(int32_t)x[rs2], *pc);
+	TRACE(output, "0x%08x:blt %s,%s,0x%03x (0x%08x<0x%08x)=%d->pc=0x%08x\n", instAdress, x_label[rs1], x_label[rs2], (simm & 0xFFF), x[rs1], x[rs2], (int32_t)x[rs1]<(int32_t)x[rs2], *pc);
 	*pc -= 4;
 }
 void bge(FILE *output, const uint8_t rs1, const uint8_t rs2, const int32_t simm, uint32_t *pc)
@@ -743,7 +940,7 @@ void bge(FILE *output, const uint8_t rs1, const uint8_t rs2, const int32_t simm,
 		*pc += simm << 1;
 	else
 		*pc += 4;
-	fprintf(output, "0x%08x:bge %s,%s,0x%03x (0x%08x>=0x%08x)=%d->pc=0x%08x\n", instAdress, x_label[rs1], x_label[rs2], simm & 0xFFF, x[rs1], x[rs2], ((int32_t)x[rs1])>=((int32_t)x[rs2]), *pc);
+	TRACE(output, "0x%08x:bge %s,%s,0x%03x (0x%08x>=0x%08x)=%d->pc=0x%08x\n", instAdress, x_label[rs1], x_label[rs2], simm & 0xFFF, x[rs1], x[rs2], ((int32_t)x[rs1])>=((int32_t)x[rs2]), *pc);
 	*pc -= 4;
 }
 void bltu(FILE *output, const uint8_t rs1, const uint8_t rs2, const int32_t simm, uint32_t *pc)
@@ -753,7 +950,7 @@ void bltu(FILE *output, const uint8_t rs1, const uint8_t rs2, const int32_t simm
 		*pc += ((uint32_t)simm) << 1;
 	else
 		*pc += 4;
-	fprintf(output, "0x%08x:bltu %s,%s,0x%03x (0x%08x<0x%08x)=%d->pc=0x%08x\n", instAdress, x_label[rs1], x_label[rs2], simm & 0xFFF, x[rs1], x[rs2], x[rs1]<x[rs2], *pc);
+	TRACE(output, "0x%08x:bltu %s,%s,0x%03x (0x%08x<0x%08x)=%d->pc=0x%08x\n", instAdress, x_label[rs1], x_label[rs2], simm & 0xFFF, x[rs1], x[rs2], x[rs1]<x[rs2], *pc);
 	*pc -= 4;
 }
 void bgeu(FILE *output, const uint8_t rs1, const uint8_t rs2, const int32_t simm, uint32_t *pc)
@@ -763,7 +960,7 @@ void bgeu(FILE *output, const uint8_t rs1, const uint8_t rs2, const int32_t simm
 		*pc += ((uint32_t)simm) << 1;
 	else
 		*pc += 4;
-	fprintf(output, "0x%08x:bgeu %s,%s,0x%03x (0x%08x>=0x%08x)=%d->pc=0x%08x\n", instAdress, x_label[rs1], x_label[rs2], simm & 0xFFF, x[rs1], x[rs2], x[rs1]>=x[rs2], *pc);
+	TRACE(output, "0x%08x:bgeu %s,%s,0x%03x (0x%08x>=0x%08x)=%d->pc=0x%08x\n", instAdress, x_label[rs1], x_label[rs2], simm & 0xFFF, x[rs1], x[rs2], x[rs1]>=x[rs2], *pc);
 	*pc -= 4;
 }
 
@@ -800,14 +997,14 @@ void B(FILE *output, const uint32_t instruction, uint32_t *pc, char *prog)
 	}
 }
 void lui(FILE *output, const uint8_t rd, const int32_t simm, uint32_t pc) {
-	fprintf(output, "0x%08x:lui %s,0x%05x %s=", pc, x_label[rd], (simm & 0xFFFFF), x_label[rd]);
+	TRACE(output, "0x%08x:lui %s,0x%05x %s=", pc, x_label[rd], (simm & 0xFFFFF), x_label[rd]);
 	x[rd] = simm << 12;
-	fprintf(output, "0x%08x\n", x[rd]);
+	TRACE(output, "0x%08x\n", x[rd]);
 }
 void auipc(FILE *output, const uint8_t rd, const int32_t simm, uint32_t pc)
 {
 	x[rd] = pc + (simm << 12);
-	fprintf(output, "0x%08x:auipc %s,0x%05x %s=0x%08x+0x%08x=0x%08x\n", pc, x_label[rd], simm & 0x1F, x_label[rd], pc, simm << 12, x[rd]);
+	TRACE(output, "0x%08x:auipc %s,0x%05x %s=0x%08x+0x%08x=0x%08x\n", pc, x_label[rd], simm & 0x1F, x_label[rd], pc, simm << 12, x[rd]);
 }
 
 void U(FILE *output, const uint32_t instruction, uint32_t pc, char *prog, const uint8_t opcode)
@@ -827,7 +1024,7 @@ void jal(FILE *output, const uint8_t rd, const int32_t simm, uint32_t *pc)
 
 	x[rd] = *pc + 4;
 	*pc = *pc +(simm << 1);
-	fprintf(output, "0x%08x:jal %s,0x%05x pc=0x%08x,%s=0x%08x\n", instAdress, x_label[rd], simm & 0xFFFFF, *pc, x_label[rd], x[rd]);
+	TRACE(output, "0x%08x:jal %s,0x%05x pc=0x%08x,%s=0x%08x\n", instAdress, x_label[rd], simm & 0xFFFFF, *pc, x_label[rd], x[rd]);
 	if (*pc - OFFSET >= 4)
 		*pc -= 4;
 }
@@ -839,51 +1036,2994 @@ void J(FILE *output, const uint32_t instruction, uint32_t *pc, char *prog)
 
 	jal(output, rd, simm, pc);
 }
-uint8_t writefile(FILE *output, uint8_t memory[], char *prog)
+/* F extension: single precision executed on the host SSE unit */
+const char *f_label[] = {
+	"ft0", "ft1", "ft2", "ft3", "ft4", "ft5", "ft6", "ft7",
+	"fs0", "fs1", "fa0", "fa1", "fa2", "fa3", "fa4", "fa5",
+	"fa6", "fa7", "fs2", "fs3", "fs4", "fs5", "fs6", "fs7",
+	"fs8", "fs9", "fs10", "fs11", "ft8", "ft9", "ft10", "ft11"
+};
+uint32_t f[32];	/* raw IEEE 754 bits */
+
+#define GET_RS3(instruction) ((instruction >> 27) & 0x1F)
+
+#define FP_QNAN 0x7FC00000	/* canonical NaN */
+#define FP_ISNAN(a) (((a) & 0x7FFFFFFF) > 0x7F800000)
+#define FP_ISSNAN(a) (FP_ISNAN(a) && !((a) & 0x00400000))
+
+/* fflags bits */
+#define FP_NX 0x01
+#define FP_UF 0x02
+#define FP_OF 0x04
+#define FP_DZ 0x08
+#define FP_NV 0x10
+
+/* MXCSR: exception flags in bits 0-5, rounding control in bits 13-14 */
+#define MXCSR_FLAGS 0x003F
+#define MXCSR_RC 0x6000
+const uint32_t mxcsr_rc[] = {
+	0x0000,	/* rne */
+	0x6000,	/* rtz */
+	0x2000,	/* rdn */
+	0x4000,	/* rup */
+	0x0000	/* rmm, no host equivalent: nearest even */
+};
+
+/*
+ * The host MXCSR flags are sticky like fflags, so the instructions never
+ * touch them: they are only folded into csr[] when the guest reads fcsr.
+ */
+void fcsr_sync(void)
 {
-	uint32_t pc = OFFSET;
+	const uint32_t m = _mm_getcsr();
+	const uint32_t flags = ((m & 0x01) << 4)	/* IE -> NV */
+		| ((m & 0x04) << 1)	/* ZE -> DZ */
+		| ((m & 0x08) >> 1)	/* OE -> OF */
+		| ((m & 0x10) >> 3)	/* UE -> UF */
+		| ((m & 0x20) >> 5);	/* PE -> NX */
 
-	while ((pc - OFFSET) < MAX_MEMORY) {
-		const uint32_t instruction = ((uint32_t *)(memory+pc-OFFSET))[0];
-		const uint8_t opcode = instruction & 0x7F;
-		switch (opcode) {
-			case 0b0110011:
-				R(output, instruction, memory, pc, prog);
+	csr[CSR_FFLAGS].x = flags;
+	csr[CSR_FCSR].x = (csr[CSR_FRM].x << 5) | flags;
+}
+/* after a write to csr[c], rebuild the other views and the host MXCSR */
+void fcsr_load(const uint16_t c)
+{
+	uint32_t flags, m;
+
+	if (c == CSR_FCSR) {
+		csr[CSR_FFLAGS].x = csr[CSR_FCSR].x;
+		csr[CSR_FRM].x = csr[CSR_FCSR].x >> 5;
+	}
+	csr[CSR_FFLAGS].x &= 0x1F;
+	csr[CSR_FRM].x &= 0x7;
+	csr[CSR_FCSR].x = (csr[CSR_FRM].x << 5) | csr[CSR_FFLAGS].x;
+
+	flags = csr[CSR_FFLAGS].x;
+	m = _mm_getcsr() & ~(MXCSR_FLAGS | MXCSR_RC);
+	m |= ((flags & FP_NV) >> 4) | ((flags & FP_DZ) >> 1) | ((flags & FP_OF) << 1) | ((flags & FP_UF) << 3) | ((flags & FP_NX) << 5);
+	if (csr[CSR_FRM].x <= 4)
+		m |= mxcsr_rc[csr[CSR_FRM].x];
+	_mm_setcsr(m);
+}
+/* raise flags the host can't produce by itself */
+void fraise(const uint32_t flags)
+{
+	_mm_setcsr(_mm_getcsr() | ((flags & FP_NV) >> 4) | ((flags & FP_NX) << 5));
+}
+/* switch the host to a static rounding mode, returns the MXCSR to give back to frestore() */
+uint32_t fround(const uint8_t rm)
+{
+	const uint32_t m = _mm_getcsr();
+
+	if (rm == 0x7 || rm == csr[CSR_FRM].x)
+		return 0;
+	_mm_setcsr((m & ~MXCSR_RC) | mxcsr_rc[rm]);
+	return m;
+}
+void frestore(const uint32_t m)
+{
+	if (m)
+		_mm_setcsr((_mm_getcsr() & ~MXCSR_RC) | (m & MXCSR_RC));
+}
+
+__m128 fval(const uint32_t a)
+{
+	return _mm_castsi128_ps(_mm_cvtsi32_si128(a));
+}
+/* result bits, x86 default NaNs are replaced by the RISC-V canonical NaN */
+uint32_t fbits(const __m128 r)
+{
+	const uint32_t a = _mm_cvtsi128_si32(_mm_castps_si128(r));
+
+	return FP_ISNAN(a) ? FP_QNAN : a;
+}
+/* total order key: -0.0 sorts below +0.0 */
+uint32_t fkey(const uint32_t a)
+{
+	return (a >> 31) ? ~a : a | 0x80000000;
+}
+
+void flw(FILE *output, uint8_t memory[], const uint8_t rd, const uint8_t rs1, const int32_t simm, uint32_t pc) {
+	uint16_t posi = x[rs1]+simm-OFFSET;
+	if (posi <= MAX_MEMORY-4) {
+		f[rd] = ((uint32_t *)(memory+posi))[0];
+		TRACE(output, "0x%08x:flw %s,0x%03x(%s) %s=mem[0x%08x]=0x%08x\n", pc, f_label[rd], simm & 0xFFF, x_label[rs1], f_label[rd], posi+OFFSET, f[rd]);
+	} else printf("flw out of memory\n");
+}
+void fsw(FILE *output, const uint8_t rs1, const uint8_t rs2, const int32_t simm, uint8_t memory[], uint32_t pc) {
+	uint16_t posi = x[rs1]+simm-OFFSET;
+	if (posi <= MAX_MEMORY-4) {
+		uint32_t *mem = ((uint32_t *)(memory+posi));
+		*mem = f[rs2];
+		TRACE(output, "0x%08x:fsw %s,0x%03x(%s) mem[0x%08x]=0x%08x\n", pc, f_label[rs2], simm & 0xFFF, x_label[rs1], posi+OFFSET, *mem);
+	} else printf("fsw out of memory\n");
+}
+
+void fadd_s(FILE *output, const uint8_t rd, const uint8_t rs1, const uint8_t rs2, uint32_t pc) {
+	const uint32_t r = fbits(_mm_add_ss(fval(f[rs1]), fval(f[rs2])));
+	TRACE(output, "0x%08x:fadd.s %s,%s,%s %s=0x%08x+0x%08x=0x%08x\n", pc, f_label[rd], f_label[rs1], f_label[rs2], f_label[rd], f[rs1], f[rs2], r);
+	f[rd] = r;
+}
+void fsub_s(FILE *output, const uint8_t rd, const uint8_t rs1, const uint8_t rs2, uint32_t pc) {
+	const uint32_t r = fbits(_mm_sub_ss(fval(f[rs1]), fval(f[rs2])));
+	TRACE(output, "0x%08x:fsub.s %s,%s,%s %s=0x%08x-0x%08x=0x%08x\n", pc, f_label[rd], f_label[rs1], f_label[rs2], f_label[rd], f[rs1], f[rs2], r);
+	f[rd] = r;
+}
+void fmul_s(FILE *output, const uint8_t rd, const uint8_t rs1, const uint8_t rs2, uint32_t pc) {
+	const uint32_t r = fbits(_mm_mul_ss(fval(f[rs1]), fval(f[rs2])));
+	TRACE(output, "0x%08x:fmul.s %s,%s,%s %s=0x%08x*0x%08x=0x%08x\n", pc, f_label[rd], f_label[rs1], f_label[rs2], f_label[rd], f[rs1], f[rs2], r);
+	f[rd] = r;
+}
+void fdiv_s(FILE *output, const uint8_t rd, const uint8_t rs1, const uint8_t rs2, uint32_t pc) {
+	const uint32_t r = fbits(_mm_div_ss(fval(f[rs1]), fval(f[rs2])));
+	TRACE(output, "0x%08x:fdiv.s %s,%s,%s %s=0x%08x/0x%08x=0x%08x\n", pc, f_label[rd], f_label[rs1], f_label[rs2], f_label[rd], f[rs1], f[rs2], r);
+	f[rd] = r;
+}
+void fsqrt_s(FILE *output, const uint8_t rd, const uint8_t rs1, uint32_t pc) {
+	const uint32_t r = fbits(_mm_sqrt_ss(fval(f[rs1])));
+	TRACE(output, "0x%08x:fsqrt.s %s,%s %s=sqrt(0x%08x)=0x%08x\n", pc, f_label[rd], f_label[rs1], f_label[rd], f[rs1], r);
+	f[rd] = r;
+}
+void fsgnj_s(FILE *output, const uint8_t rd, const uint8_t rs1, const uint8_t rs2, const uint8_t funct3, uint32_t pc) {
+	const char *name[] = { "fsgnj.s", "fsgnjn.s", "fsgnjx.s" };
+	uint32_t sign = f[rs2] & 0x80000000;
+	uint32_t r;
+
+	if (funct3 == 0x1)
+		sign ^= 0x80000000;
+	else if (funct3 == 0x2)
+		sign ^= f[rs1] & 0x80000000;
+	r = (f[rs1] & 0x7FFFFFFF) | sign;
+	TRACE(output, "0x%08x:%s %s,%s,%s %s=0x%08x\n", pc, name[funct3], f_label[rd], f_label[rs1], f_label[rs2], f_label[rd], r);
+	f[rd] = r;
+}
+void fminmax_s(FILE *output, const uint8_t rd, const uint8_t rs1, const uint8_t rs2, const uint8_t funct3, uint32_t pc) {
+	const uint32_t a = f[rs1], b = f[rs2];
+	uint32_t r;
+
+	if (FP_ISSNAN(a) || FP_ISSNAN(b))
+		fraise(FP_NV);
+	if (FP_ISNAN(a) && FP_ISNAN(b))
+		r = FP_QNAN;
+	else if (FP_ISNAN(a))
+		r = b;
+	else if (FP_ISNAN(b))
+		r = a;
+	else if (funct3 == 0x0)	/* fmin */
+		r = fkey(a) < fkey(b) ? a : b;
+	else	/* fmax */
+		r = fkey(a) > fkey(b) ? a : b;
+	TRACE(output, "0x%08x:%s %s,%s,%s %s=%s(0x%08x,0x%08x)=0x%08x\n", pc, funct3 ? "fmax.s" : "fmin.s", f_label[rd], f_label[rs1], f_label[rs2], f_label[rd], funct3 ? "max" : "min", a, b, r);
+	f[rd] = r;
+}
+void fcmp_s(FILE *output, const uint8_t rd, const uint8_t rs1, const uint8_t rs2, const uint8_t funct3, uint32_t pc) {
+	const char *name[] = { "fle.s", "flt.s", "feq.s" };
+	const char *op[] = { "<=", "<", "==" };
+	const uint32_t a = f[rs1], b = f[rs2];
+	uint32_t r;
+
+	if (FP_ISNAN(a) || FP_ISNAN(b)) {
+		/* feq is a quiet comparison, flt and fle signal on any NaN */
+		if (funct3 != 0x2 || FP_ISSNAN(a) || FP_ISSNAN(b))
+			fraise(FP_NV);
+		r = 0;
+	} else if (funct3 == 0x2)
+		r = _mm_comieq_ss(fval(a), fval(b));
+	else if (funct3 == 0x1)
+		r = _mm_comilt_ss(fval(a), fval(b));
+	else
+		r = _mm_comile_ss(fval(a), fval(b));
+	TRACE(output, "0x%08x:%s %s,%s,%s %s=(0x%08x%s0x%08x)=%u\n", pc, name[funct3], x_label[rd], f_label[rs1], f_label[rs2], x_label[rd], a, op[funct3], b, r);
+	x[rd] = r;
+}
+void fclass_s(FILE *output, const uint8_t rd, const uint8_t rs1, uint32_t pc) {
+	const uint32_t a = f[rs1];
+	const uint32_t sign = a >> 31, exp = (a >> 23) & 0xFF, frac = a & 0x7FFFFF;
+	uint32_t r;
+
+	if (exp == 0xFF)
+		r = frac == 0 ? (sign ? 1 << 0 : 1 << 7) : (FP_ISSNAN(a) ? 1 << 8 : 1 << 9);
+	else if (exp == 0)
+		r = frac == 0 ? (sign ? 1 << 3 : 1 << 4) : (sign ? 1 << 2 : 1 << 5);
+	else
+		r = sign ? 1 << 1 : 1 << 6;
+	TRACE(output, "0x%08x:fclass.s %s,%s %s=class(0x%08x)=0x%03x\n", pc, x_label[rd], f_label[rs1], x_label[rd], a, r);
+	x[rd] = r;
+}
+void fcvt_w_s(FILE *output, const uint8_t rd, const uint8_t rs1, const uint8_t rs2, uint32_t pc) {
+	const uint32_t a = f[rs1];
+	const uint32_t m = _mm_getcsr();
+	int64_t v;
+	uint32_t r;
+
+	if (FP_ISNAN(a))
+		v = INT64_MAX;
+	else
+		v = _mm_cvtss_si64(fval(a));	/* INT64_MIN on host overflow */
+	if (v == INT64_MIN)
+		v = (a >> 31) ? INT64_MIN : INT64_MAX;
+	if (rs2 == 0x0 && (v > INT32_MAX || v < INT32_MIN)) {	/* fcvt.w.s */
+		r = v > 0 ? INT32_MAX : (uint32_t)INT32_MIN;
+		_mm_setcsr(m);	/* invalid conversions only raise NV */
+		fraise(FP_NV);
+	} else if (rs2 == 0x1 && (v > UINT32_MAX || v < 0)) {	/* fcvt.wu.s */
+		r = v > 0 ? UINT32_MAX : 0;
+		_mm_setcsr(m);
+		fraise(FP_NV);
+	} else
+		r = v;
+	TRACE(output, "0x%08x:%s %s,%s %s=(int)0x%08x=0x%08x\n", pc, rs2 ? "fcvt.wu.s" : "fcvt.w.s", x_label[rd], f_label[rs1], x_label[rd], a, r);
+	x[rd] = r;
+}
+void fcvt_s_w(FILE *output, const uint8_t rd, const uint8_t rs1, const uint8_t rs2, uint32_t pc) {
+	uint32_t r;
+
+	if (rs2 == 0x0)	/* fcvt.s.w */
+		r = fbits(_mm_cvtsi32_ss(_mm_setzero_ps(), (int32_t)x[rs1]));
+	else	/* fcvt.s.wu */
+		r = fbits(_mm_cvtsi64_ss(_mm_setzero_ps(), (int64_t)x[rs1]));
+	TRACE(output, "0x%08x:%s %s,%s %s=(float)0x%08x=0x%08x\n", pc, rs2 ? "fcvt.s.wu" : "fcvt.s.w", f_label[rd], x_label[rs1], f_label[rd], x[rs1], r);
+	f[rd] = r;
+}
+void fmv_x_w(FILE *output, const uint8_t rd, const uint8_t rs1, uint32_t pc) {
+	TRACE(output, "0x%08x:fmv.x.w %s,%s %s=0x%08x\n", pc, x_label[rd], f_label[rs1], x_label[rd], f[rs1]);
+	x[rd] = f[rs1];
+}
+void fmv_w_x(FILE *output, const uint8_t rd, const uint8_t rs1, uint32_t pc) {
+	TRACE(output, "0x%08x:fmv.w.x %s,%s %s=0x%08x\n", pc, f_label[rd], x_label[rs1], f_label[rd], x[rs1]);
+	f[rd] = x[rs1];
+}
+
+/* fmadd.s, fmsub.s, fnmsub.s and fnmadd.s, a single rounding through fmaf() */
+void R4(FILE *output, const uint32_t instruction, uint32_t pc, char *prog, const uint8_t opcode)
+{
+	const char *name[] = { "fmadd.s", "fmsub.s", "fnmsub.s", "fnmadd.s" };
+	const char *sign[] = { "+", "-", "+", "-" };
+	const uint8_t rd = GET_RD(instruction);
+	const uint8_t rs1 = GET_RS1(instruction);
+	const uint8_t rs2 = GET_RS2(instruction);
+	const uint8_t rs3 = GET_RS3(instruction);
+	const uint8_t rm = GET_FUNCT3(instruction);
+	const uint8_t op = (opcode >> 2) & 0x3;
+	uint32_t a = f[rs1], c = f[rs3], m, r;
+
+	if ((instruction >> 25) & 0x3 || rm == 0x5 || rm == 0x6 || (rm == 0x7 && csr[CSR_FRM].x > 4)) {
+		fprintf(stderr, "%s: unknown R4 instruction %x\n", prog, instruction);
+		return;
+	}
+	if (op >= 0x2)	/* negated product */
+		a ^= 0x80000000;
+	if (op & 0x1)	/* subtracted addend */
+		c ^= 0x80000000;
+	m = fround(rm);
+	r = fbits(_mm_set_ss(fmaf(_mm_cvtss_f32(fval(a)), _mm_cvtss_f32(fval(f[rs2])), _mm_cvtss_f32(fval(c)))));
+	frestore(m);
+	TRACE(output, "0x%08x:%s %s,%s,%s,%s %s=%s0x%08x*0x%08x%s0x%08x=0x%08x\n", pc, name[op], f_label[rd], f_label[rs1], f_label[rs2], f_label[rs3], f_label[rd], op >= 0x2 ? "-" : "", f[rs1], f[rs2], sign[op], f[rs3], r);
+	f[rd] = r;
+}
+
+void F(FILE *output, const uint32_t instruction, uint32_t pc, char *prog)
+{
+	const uint8_t rd = GET_RD(instruction);
+	const uint8_t rs1 = GET_RS1(instruction);
+	const uint8_t rs2 = GET_RS2(instruction);
+	const uint8_t funct7 = GET_FUNCT7(instruction);
+	const uint8_t rm = GET_FUNCT3(instruction);
+	uint8_t status = SUCCESS;
+	uint32_t m;
+
+	if (rm == 0x5 || rm == 0x6 || (rm == 0x7 && csr[CSR_FRM].x > 4)) {
+		fprintf(stderr, "%s: invalid rounding mode %x\n", prog, instruction);
+		return;
+	}
+	m = fround(rm);
+	switch (funct7) {
+		case 0x00:
+			fadd_s(output, rd, rs1, rs2, pc);
+			break;
+		case 0x04:
+			fsub_s(output, rd, rs1, rs2, pc);
+			break;
+		case 0x08:
+			fmul_s(output, rd, rs1, rs2, pc);
+			break;
+		case 0x0C:
+			fdiv_s(output, rd, rs1, rs2, pc);
+			break;
+		case 0x2C:
+			if (rs2 == 0x0)
+				fsqrt_s(output, rd, rs1, pc);
+			else
+				status = ERROR;
+			break;
+		case 0x10:	/* fsgnj, fsgnjn and fsgnjx */
+			if (rm <= 0x2)
+				fsgnj_s(output, rd, rs1, rs2, rm, pc);
+			else
+				status = ERROR;
+			break;
+		case 0x14:	/* fmin and fmax */
+			if (rm <= 0x1)
+				fminmax_s(output, rd, rs1, rs2, rm, pc);
+			else
+				status = ERROR;
+			break;
+		case 0x50:	/* fle, flt and feq */
+			if (rm <= 0x2)
+				fcmp_s(output, rd, rs1, rs2, rm, pc);
+			else
+				status = ERROR;
+			break;
+		case 0x60:	/* fcvt.w.s and fcvt.wu.s */
+			if (rs2 <= 0x1)
+				fcvt_w_s(output, rd, rs1, rs2, pc);
+			else
+				status = ERROR;
+			break;
+		case 0x68:	/* fcvt.s.w and fcvt.s.wu */
+			if (rs2 <= 0x1)
+				fcvt_s_w(output, rd, rs1, rs2, pc);
+			else
+				status = ERROR;
+			break;
+		case 0x70:	/* fmv.x.w and fclass */
+			if (rs2 == 0x0 && rm == 0x0)
+				fmv_x_w(output, rd, rs1, pc);
+			else if (rs2 == 0x0 && rm == 0x1)
+				fclass_s(output, rd, rs1, pc);
+			else
+				status = ERROR;
+			break;
+		case 0x78:
+			if (rs2 == 0x0 && rm == 0x0)
+				fmv_w_x(output, rd, rs1, pc);
+			else
+				status = ERROR;
+			break;
+		default:
+			status = ERROR;
+			break;
+	}
+	frestore(m);
+	if (status == ERROR)
+		fprintf(stderr, "%s: unknown F instruction %x\n", prog, instruction);
+}
+
+/* V extension subset, ELEN=32, element groups run on host SIMD kernels */
+uint8_t v[32][VLENB] __attribute__((aligned(32)));
+uint8_t vtmp[8 * VLENB] __attribute__((aligned(32)));	/* splatted scalar operand */
+
+#define VREG(r) ((uint8_t *)v + (r) * VLENB)
+#define VMASK(i) ((v[0][(i) >> 3] >> ((i) & 7)) & 1)
+#define VSEW() (1 << ((csr[CSR_VTYPE].x >> 3) & 0x7))	/* element bytes */
+#define VILL() (csr[CSR_VTYPE].x >> 31)
+/* vl for the kernels, never past VLMAX even if a checkpoint says otherwise */
+#define VL() (csr[CSR_VL].x < vlmax(csr[CSR_VTYPE].x) ? csr[CSR_VL].x : vlmax(csr[CSR_VTYPE].x))
+
+/* element operations, see valu() */
+#define VK_ADD 0
+#define VK_SUB 1
+#define VK_RSUB 2
+#define VK_AND 3
+#define VK_OR 4
+#define VK_XOR 5
+#define VK_SLL 6
+#define VK_SRL 7
+#define VK_SRA 8
+#define VK_MUL 9
+#define VK_MULH 10
+#define VK_MULHU 11
+#define VK_MINU 12
+#define VK_MIN 13
+#define VK_MAXU 14
+#define VK_MAX 15
+
+uint32_t vget(const uint8_t *r, const uint32_t i, const uint8_t eb)
+{
+	switch (eb) {
+		case 1:
+			return r[i];
+		case 2:
+			return ((uint16_t *)r)[i];
+		default:
+			return ((uint32_t *)r)[i];
+	}
+}
+void vset(uint8_t *r, const uint32_t i, const uint8_t eb, const uint32_t a)
+{
+	switch (eb) {
+		case 1:
+			r[i] = a;
+			break;
+		case 2:
+			((uint16_t *)r)[i] = a;
+			break;
+		default:
+			((uint32_t *)r)[i] = a;
+			break;
+	}
+}
+int32_t vsext(const uint32_t a, const uint8_t eb)
+{
+	return eb == 4 ? (int32_t)a : eb == 2 ? (int16_t)a : (int8_t)a;
+}
+
+/* one element, a is vs2 and b is vs1/rs1/imm */
+uint32_t valu(const uint8_t op, const uint32_t a, const uint32_t b, const uint8_t eb)
+{
+	const uint8_t bits = eb * 8;
+
+	switch (op) {
+		case VK_ADD:
+			return a + b;
+		case VK_SUB:
+			return a - b;
+		case VK_RSUB:
+			return b - a;
+		case VK_AND:
+			return a & b;
+		case VK_OR:
+			return a | b;
+		case VK_XOR:
+			return a ^ b;
+		case VK_SLL:
+			return a << (b & (bits - 1));
+		case VK_SRL:
+			return a >> (b & (bits - 1));
+		case VK_SRA:
+			return vsext(a, eb) >> (b & (bits - 1));
+		case VK_MUL:
+			return a * b;
+		case VK_MULH:
+			return ((int64_t)vsext(a, eb) * vsext(b, eb)) >> bits;
+		case VK_MULHU:
+			return ((uint64_t)a * b) >> bits;
+		case VK_MINU:
+			return a < b ? a : b;
+		case VK_MIN:
+			return vsext(a, eb) < vsext(b, eb) ? a : b;
+		case VK_MAXU:
+			return a > b ? a : b;
+		default:	/* VK_MAX */
+			return vsext(a, eb) > vsext(b, eb) ? a : b;
+	}
+}
+
+/*
+ * Host SIMD body of an unmasked element-wise op over n bytes. Returns how
+ * many bytes it did, the caller finishes the rest with valu(). AVX2 takes
+ * 32 bytes at a time and SSE2 what is left in 16, so a VLEN=128 LMUL=1
+ * group runs on SSE2 in an AVX2 build too.
+ */
+uint32_t vsimd(const uint8_t op, uint8_t *d, const uint8_t *a, const uint8_t *b, const uint32_t n, const uint8_t eb)
+{
+	uint32_t i = 0;
+#if defined(__AVX2__)
+	const __m256i sh = _mm256_set1_epi32(31);
+
+	for (; i + 32 <= n; i += 32) {
+		const __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+		const __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+		__m256i r;
+
+		switch (op) {
+			case VK_ADD:
+				r = eb == 1 ? _mm256_add_epi8(va, vb) : eb == 2 ? _mm256_add_epi16(va, vb) : _mm256_add_epi32(va, vb);
+				break;
+			case VK_SUB:
+				r = eb == 1 ? _mm256_sub_epi8(va, vb) : eb == 2 ? _mm256_sub_epi16(va, vb) : _mm256_sub_epi32(va, vb);
+				break;
+			case VK_RSUB:
+				r = eb == 1 ? _mm256_sub_epi8(vb, va) : eb == 2 ? _mm256_sub_epi16(vb, va) : _mm256_sub_epi32(vb, va);
 				break;
-			case 0b0010011:
-			case 0b0000011:
-			case 0b1100111:
-			case 0b1110011:
-				I(output, instruction, memory, &pc, prog, opcode);
+			case VK_AND:
+				r = _mm256_and_si256(va, vb);
 				break;
-			case 0b0100011:
-				S(output, instruction, memory, pc, prog);
+			case VK_OR:
+				r = _mm256_or_si256(va, vb);
 				break;
-			case 0b1100011:
-				B(output, instruction, &pc, prog);
+			case VK_XOR:
+				r = _mm256_xor_si256(va, vb);
 				break;
-			case 0b0110111:
-			case 0b0010111:
-				U(output, instruction, pc, prog, opcode);
+			case VK_MUL:
+				if (eb == 1)
+					return i;
+				r = eb == 2 ? _mm256_mullo_epi16(va, vb) : _mm256_mullo_epi32(va, vb);
 				break;
-			case 0b1101111:
-				J(output, instruction, &pc, prog);
+			case VK_SLL:
+				if (eb != 4)
+					return i;
+				r = _mm256_sllv_epi32(va, _mm256_and_si256(vb, sh));
+				break;
+			case VK_SRL:
+				if (eb != 4)
+					return i;
+				r = _mm256_srlv_epi32(va, _mm256_and_si256(vb, sh));
+				break;
+			case VK_SRA:
+				if (eb != 4)
+					return i;
+				r = _mm256_srav_epi32(va, _mm256_and_si256(vb, sh));
 				break;
 			default:
-				//mstatus
-				csr[0].x = 0x00001800;
-				//mcause
-				csr[4].x = 0x1;
-				// pc = mtvec
-				pc = csr[2].x - 4;
-				fprintf(output, ">exception:instruction_fault cause=0x%08x,epc=0x%08x,tval=0x%08x\n", csr[4].x, csr[3].x, csr[5].x);
-				// mtval = instruction
-				csr[5].x = instruction;
-				printf("unknown opcode. %x\n", instruction);
-				break;
-		}
-		pc += 4;
-		x[0] = 0;
+				return i;
+		}
+		_mm256_storeu_si256((__m256i *)(d + i), r);
+	}
+#endif
+#if defined(__SSE2__)
+	for (; i + 16 <= n; i += 16) {
+		const __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+		const __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+		__m128i r;
+
+		switch (op) {
+			case VK_ADD:
+				r = eb == 1 ? _mm_add_epi8(va, vb) : eb == 2 ? _mm_add_epi16(va, vb) : _mm_add_epi32(va, vb);
+				break;
+			case VK_SUB:
+				r = eb == 1 ? _mm_sub_epi8(va, vb) : eb == 2 ? _mm_sub_epi16(va, vb) : _mm_sub_epi32(va, vb);
+				break;
+			case VK_RSUB:
+				r = eb == 1 ? _mm_sub_epi8(vb, va) : eb == 2 ? _mm_sub_epi16(vb, va) : _mm_sub_epi32(vb, va);
+				break;
+			case VK_AND:
+				r = _mm_and_si128(va, vb);
+				break;
+			case VK_OR:
+				r = _mm_or_si128(va, vb);
+				break;
+			case VK_XOR:
+				r = _mm_xor_si128(va, vb);
+				break;
+#if defined(__AVX2__)
+			case VK_MUL:
+				if (eb == 1)
+					return i;
+				r = eb == 2 ? _mm_mullo_epi16(va, vb) : _mm_mullo_epi32(va, vb);
+				break;
+			case VK_SLL:
+				if (eb != 4)
+					return i;
+				r = _mm_sllv_epi32(va, _mm_and_si128(vb, _mm256_castsi256_si128(sh)));
+				break;
+			case VK_SRL:
+				if (eb != 4)
+					return i;
+				r = _mm_srlv_epi32(va, _mm_and_si128(vb, _mm256_castsi256_si128(sh)));
+				break;
+			case VK_SRA:
+				if (eb != 4)
+					return i;
+				r = _mm_srav_epi32(va, _mm_and_si128(vb, _mm256_castsi256_si128(sh)));
+				break;
+#else
+			case VK_MUL:
+				if (eb != 2)	/* no 8 or 32 bit mullo before SSE4.1 */
+					return i;
+				r = _mm_mullo_epi16(va, vb);
+				break;
+#endif
+			default:
+				return i;
+		}
+		_mm_storeu_si128((__m128i *)(d + i), r);
+	}
+#endif
+	return i;
+}
+
+/* vd = a op b over vl elements, masked off and tail elements are left undisturbed */
+void vkernel(const uint8_t op, uint8_t *d, const uint8_t *a, const uint8_t *b, const uint32_t vl, const uint8_t eb, const uint8_t vm)
+{
+	uint32_t i = 0;
+
+	if (vm)
+		i = vsimd(op, d, a, b, vl * eb, eb) / eb;
+	for (; i < vl; i++)
+		if (vm || VMASK(i))
+			vset(d, i, eb, valu(op, vget(a, i, eb), vget(b, i, eb), eb));
+}
+uint8_t *vsplat(const uint32_t a, const uint32_t vl, const uint8_t eb)
+{
+	uint32_t i;
+
+	for (i = 0; i < vl; i++)
+		vset(vtmp, i, eb, a);
+	return vtmp;
+}
+
+/* register group size for the current vtype, 0 when the group doesn't fit */
+uint8_t vgroup(const uint8_t r)
+{
+	const uint8_t lmul = csr[CSR_VTYPE].x & 0x7;
+	const uint8_t regs = lmul < 4 ? 1 << lmul : 1;
+
+	return (r % regs || r + regs > 32) ? 0 : regs;
+}
+/* VLMAX for a vtype, 0 for the ones this ELEN=32 implementation reserves */
+uint32_t vlmax(const uint32_t vtype)
+{
+	const uint8_t sew = (vtype >> 3) & 0x7;
+	const uint8_t lmul = vtype & 0x7;
+
+	if (sew > 2 || lmul == 4 || (vtype >> 8) != 0)
+		return 0;
+	if (lmul < 4)
+		return (VLENB << lmul) >> sew;
+	if (sew + (8 - lmul) > 2)	/* SEW > LMUL * ELEN */
+		return 0;
+	return (VLENB >> (8 - lmul)) >> sew;
+}
+
+void vsetvl(FILE *output, const uint32_t instruction, uint32_t pc)
+{
+	const uint8_t rd = GET_RD(instruction);
+	const uint8_t rs1 = GET_RS1(instruction);
+	const char *name;
+	uint32_t vtype, avl, max;
+
+	if ((instruction >> 30) == 0x3) {	/* vsetivli */
+		name = "vsetivli";
+		vtype = (instruction >> 20) & 0x3FF;
+		avl = rs1;
+	} else {
+		if (instruction >> 31) {	/* vsetvl */
+			name = "vsetvl";
+			vtype = x[GET_RS2(instruction)];
+		} else {	/* vsetvli */
+			name = "vsetvli";
+			vtype = (instruction >> 20) & 0x7FF;
+		}
+		if (rs1 != 0)
+			avl = x[rs1];
+		else if (rd != 0)
+			avl = UINT32_MAX;
+		else
+			avl = csr[CSR_VL].x;
+	}
+	if ((max = vlmax(vtype)) == 0) {
+		csr[CSR_VTYPE].x = 0x80000000;
+		csr[CSR_VL].x = 0;
+	} else {
+		csr[CSR_VTYPE].x = vtype;
+		csr[CSR_VL].x = avl < max ? avl : max;
+	}
+	csr[CSR_VSTART].x = 0;
+	if ((instruction >> 30) == 0x3)
+		TRACE(output, "0x%08x:%s %s,%u,0x%03x %s=vl=%u,vtype=0x%08x\n", pc, name, x_label[rd], rs1, vtype & 0x7FF, x_label[rd], csr[CSR_VL].x, csr[CSR_VTYPE].x);
+	else
+		TRACE(output, "0x%08x:%s %s,%s,0x%03x %s=vl=%u,vtype=0x%08x\n", pc, name, x_label[rd], x_label[rs1], vtype & 0x7FF, x_label[rd], csr[CSR_VL].x, csr[CSR_VTYPE].x);
+	x[rd] = csr[CSR_VL].x;
+}
+
+/* unit-stride and strided loads and stores */
+void vmem(FILE *output, const uint32_t instruction, uint8_t memory[], uint32_t *pc, char *prog, const uint8_t store)
+{
+	const uint8_t vd = GET_RD(instruction);
+	const uint8_t rs1 = GET_RS1(instruction);
+	const uint8_t rs2 = GET_RS2(instruction);
+	const uint8_t width = GET_FUNCT3(instruction);
+	const uint8_t mop = (instruction >> 26) & 0x3;
+	const uint8_t vm = (instruction >> 25) & 0x1;
+	const uint8_t eb = width == 0x0 ? 1 : width == 0x5 ? 2 : width == 0x6 ? 4 : 0;
+	const uint32_t vl = VL();
+	const int64_t base = (int64_t)x[rs1] - OFFSET;
+	const int64_t stride = mop == 0x2 ? (int32_t)x[rs2] : eb;
+	uint8_t *d = VREG(vd);
+	int64_t off;
+	uint32_t i;
+
+	if (eb == 0 || (instruction >> 28) != 0 || (mop != 0x0 && mop != 0x2) || (mop == 0x0 && rs2 != 0) || VILL() || (vl * eb + VLENB - 1) / VLENB + vd > 32) {
+		fprintf(stderr, "%s: unknown V instruction %x\n", prog, instruction);
+		return;
+	}
+	for (i = 0; i < vl; i++) {	/* every active element in memory, or nothing is done */
+		off = base + stride * i;
+		if ((vm || VMASK(i)) && (off < 0 || off + eb > MAX_MEMORY)) {
+			//mstatus
+			csr[0].x = 0x00001800;
+			//mcause
+			csr[4].x = store ? 0x5 : 0x2;
+			// *pc = mtvec
+			*pc = csr[2].x - 4;
+			flight_dump(output);
+			fprintf(output, ">exception:%s cause=0x%08x,epc=0x%08x,tval=0x%08x\n", store ? "store_fault" : "load_fault", csr[4].x, csr[3].x, csr[5].x);
+			//tval = address
+			csr[5].x = off + OFFSET;
+			return;
+		}
+	}
+	heat_vector(*pc, instruction, store);
+	if (mop == 0x0 && vm) {	/* the common case is a plain copy */
+		if (store)
+			memcpy(memory + base, d, vl * eb);
+		else
+			memcpy(d, memory + base, vl * eb);
+	} else
+		for (i = 0; i < vl; i++)
+			if (vm || VMASK(i)) {
+				uint8_t *mem = memory + (base + stride * i);
+				if (store)
+					memcpy(mem, d + i * eb, eb);
+				else
+					memcpy(d + i * eb, mem, eb);
+			}
+	TRACE(output, "0x%08x:%s%u.v v%u,(%s)%s%s%s %s[0x%08x]=v%u[0..%u]\n", *pc, store ? (mop ? "vsse" : "vse") : (mop ? "vlse" : "vle"), eb * 8, vd, x_label[rs1], mop ? "," : "", mop ? x_label[rs2] : "", vm ? "" : ",v0.t", mop ? "mem+stride" : "mem", x[rs1], vd, vl);
+}
+
+/* integer compares writing a mask */
+uint8_t vcmp(const uint8_t funct6, const uint32_t a, const uint32_t b, const uint8_t eb)
+{
+	switch (funct6) {
+		case 0x18:	/* vmseq */
+			return a == b;
+		case 0x19:	/* vmsne */
+			return a != b;
+		case 0x1A:	/* vmsltu */
+			return a < b;
+		case 0x1B:	/* vmslt */
+			return vsext(a, eb) < vsext(b, eb);
+		case 0x1C:	/* vmsleu */
+			return a <= b;
+		case 0x1D:	/* vmsle */
+			return vsext(a, eb) <= vsext(b, eb);
+		case 0x1E:	/* vmsgtu */
+			return a > b;
+		default:	/* vmsgt */
+			return vsext(a, eb) > vsext(b, eb);
+	}
+}
+void vmask(uint8_t *d, const uint8_t funct6, const uint8_t *a, const uint8_t *b, const uint32_t vl, const uint8_t eb, const uint8_t vm)
+{
+	uint8_t bits[8 * VLENB];
+	uint32_t i;
+
+	for (i = 0; i < vl; i++)
+		bits[i] = (vm || VMASK(i)) ? vcmp(funct6, vget(a, i, eb), vget(b, i, eb), eb) : (d[i >> 3] >> (i & 7)) & 1;
+	for (i = 0; i < vl; i++)
+		d[i >> 3] = (d[i >> 3] & ~(1 << (i & 7))) | (bits[i] << (i & 7));
+}
+
+/* "pc:name.suffix vd,vs2,src" with src printed for the operand kind */
+void vtrace(FILE *output, uint32_t pc, const char *name, const uint8_t vd, const uint8_t vs2, const uint8_t funct3, const uint8_t vs1, const uint8_t vm)
+{
+	switch (funct3) {
+		case 0x0:
+		case 0x2:
+			TRACE(output, "0x%08x:%s.vv v%u,v%u,v%u%s ", pc, name, vd, vs2, vs1, vm ? "" : ",v0.t");
+			break;
+		case 0x3:
+			TRACE(output, "0x%08x:%s.vi v%u,v%u,%d%s ", pc, name, vd, vs2, (int32_t)(vs1 << 27) >> 27, vm ? "" : ",v0.t");
+			break;
+		default:
+			TRACE(output, "0x%08x:%s.vx v%u,v%u,%s%s ", pc, name, vd, vs2, x_label[vs1], vm ? "" : ",v0.t");
+			break;
+	}
+}
+
+const char *vopi_name[] = {
+	[0x00] = "vadd", [0x02] = "vsub", [0x03] = "vrsub", [0x09] = "vand", [0x0A] = "vor", [0x0B] = "vxor",
+	[0x17] = "vmerge", [0x18] = "vmseq", [0x19] = "vmsne", [0x1A] = "vmsltu", [0x1B] = "vmslt",
+	[0x1C] = "vmsleu", [0x1D] = "vmsle", [0x1E] = "vmsgtu", [0x1F] = "vmsgt",
+	[0x25] = "vsll", [0x28] = "vsrl", [0x29] = "vsra", [0x3F] = NULL
+};
+/* OPIVV, OPIVX and OPIVI */
+uint8_t vopi(FILE *output, const uint32_t instruction, uint32_t pc)
+{
+	const uint8_t funct6 = instruction >> 26;
+	const uint8_t vm = (instruction >> 25) & 0x1;
+	const uint8_t vs2 = GET_RS2(instruction);
+	const uint8_t vs1 = GET_RS1(instruction);
+	const uint8_t vd = GET_RD(instruction);
+	const uint8_t funct3 = GET_FUNCT3(instruction);
+	const uint8_t eb = VSEW();
+	const uint32_t vl = VL();
+	const uint8_t *b;
+	uint8_t op;
+	uint32_t i;
+
+	if (funct3 == 0x0)
+		b = VREG(vs1);
+	else if (funct3 == 0x4)
+		b = vsplat(x[vs1], vl, eb);
+	else if (funct6 >= 0x25)	/* shift amounts are unsigned */
+		b = vsplat(vs1, vl, eb);
+	else
+		b = vsplat((int32_t)(vs1 << 27) >> 27, vl, eb);
+
+	if (!vopi_name[funct6] || !vgroup(vd) || !vgroup(vs2) || (funct3 == 0x0 && !vgroup(vs1)))
+		return ERROR;
+	switch (funct6) {
+		case 0x00:
+			op = VK_ADD;
+			break;
+		case 0x02:
+			if (funct3 == 0x3)
+				return ERROR;
+			op = VK_SUB;
+			break;
+		case 0x03:
+			if (funct3 == 0x0)
+				return ERROR;
+			op = VK_RSUB;
+			break;
+		case 0x09:
+			op = VK_AND;
+			break;
+		case 0x0A:
+			op = VK_OR;
+			break;
+		case 0x0B:
+			op = VK_XOR;
+			break;
+		case 0x25:
+			op = VK_SLL;
+			break;
+		case 0x28:
+			op = VK_SRL;
+			break;
+		case 0x29:
+			op = VK_SRA;
+			break;
+		case 0x17:	/* vmerge and vmv.v */
+			if (vm && vs2 != 0)
+				return ERROR;
+			for (i = 0; i < vl; i++)
+				vset(VREG(vd), i, eb, (vm || VMASK(i)) ? vget(b, i, eb) : vget(VREG(vs2), i, eb));
+			if (!vm)
+				vtrace(output, pc, "vmerge", vd, vs2, funct3, vs1, 1);
+			else if (funct3 == 0x0)
+				TRACE(output, "0x%08x:vmv.v.v v%u,v%u ", pc, vd, vs1);
+			else if (funct3 == 0x4)
+				TRACE(output, "0x%08x:vmv.v.x v%u,%s ", pc, vd, x_label[vs1]);
+			else
+				TRACE(output, "0x%08x:vmv.v.i v%u,%d ", pc, vd, (int32_t)(vs1 << 27) >> 27);
+			TRACE(output, "v%u[0]=0x%08x vl=%u\n", vd, vget(VREG(vd), 0, eb), vl);
+			return SUCCESS;
+		default:	/* compares */
+			if ((funct6 == 0x1A || funct6 == 0x1B) && funct3 == 0x3)
+				return ERROR;
+			if ((funct6 == 0x1E || funct6 == 0x1F) && funct3 == 0x0)
+				return ERROR;
+			vmask(VREG(vd), funct6, VREG(vs2), b, vl, eb, vm);
+			vtrace(output, pc, vopi_name[funct6], vd, vs2, funct3, vs1, vm);
+			TRACE(output, "v%u=0x%08x vl=%u\n", vd, vget(VREG(vd), 0, 4), vl);
+			return SUCCESS;
+	}
+	vkernel(op, VREG(vd), VREG(vs2), b, vl, eb, vm);
+	vtrace(output, pc, vopi_name[funct6], vd, vs2, funct3, vs1, vm);
+	TRACE(output, "v%u[0]=0x%08x vl=%u\n", vd, vget(VREG(vd), 0, eb), vl);
+	return SUCCESS;
+}
+
+const char *vred_name[] = { "vredsum", "vredand", "vredor", "vredxor", "vredminu", "vredmin", "vredmaxu", "vredmax" };
+const char *vmlogic_name[] = { "vmandn", "vmand", "vmor", "vmxor", "vmorn", "vmnand", "vmnor", "vmxnor" };
+/* OPMVV and OPMVX */
+uint8_t vopm(FILE *output, const uint32_t instruction, uint32_t pc)
+{
+	const uint8_t funct6 = instruction >> 26;
+	const uint8_t vm = (instruction >> 25) & 0x1;
+	const uint8_t vs2 = GET_RS2(instruction);
+	const uint8_t vs1 = GET_RS1(instruction);
+	const uint8_t vd = GET_RD(instruction);
+	const uint8_t funct3 = GET_FUNCT3(instruction);
+	const uint8_t eb = VSEW();
+	const uint32_t vl = VL();
+	uint32_t i, r;
+
+	if (funct6 <= 0x07 && funct3 == 0x2) {	/* reductions */
+		const uint8_t op[] = { VK_ADD, VK_AND, VK_OR, VK_XOR, VK_MINU, VK_MIN, VK_MAXU, VK_MAX };
+		if (!vgroup(vs2))
+			return ERROR;
+		r = vget(VREG(vs1), 0, eb);
+		for (i = 0; i < vl; i++)
+			if (vm || VMASK(i))
+				r = valu(op[funct6], r, vget(VREG(vs2), i, eb), eb);
+		if (vl)
+			vset(VREG(vd), 0, eb, r);
+		TRACE(output, "0x%08x:%s.vs v%u,v%u,v%u%s v%u[0]=0x%08x vl=%u\n", pc, vred_name[funct6], vd, vs2, vs1, vm ? "" : ",v0.t", vd, vget(VREG(vd), 0, eb), vl);
+		return SUCCESS;
+	}
+	if (funct6 >= 0x18 && funct6 <= 0x1F && funct3 == 0x2) {	/* mask logical */
+		const uint8_t *a = VREG(vs2), *b = VREG(vs1);
+		uint8_t *d = VREG(vd);
+		if (!vm)
+			return ERROR;
+		for (i = 0; i < vl; i++) {
+			const uint8_t p = (a[i >> 3] >> (i & 7)) & 1, q = (b[i >> 3] >> (i & 7)) & 1;
+			uint8_t bit;
+			switch (funct6) {
+				case 0x18:
+					bit = p & !q;
+					break;
+				case 0x19:
+					bit = p & q;
+					break;
+				case 0x1A:
+					bit = p | q;
+					break;
+				case 0x1B:
+					bit = p ^ q;
+					break;
+				case 0x1C:
+					bit = p | !q;
+					break;
+				case 0x1D:
+					bit = !(p & q);
+					break;
+				case 0x1E:
+					bit = !(p | q);
+					break;
+				default:
+					bit = !(p ^ q);
+					break;
+			}
+			d[i >> 3] = (d[i >> 3] & ~(1 << (i & 7))) | (bit << (i & 7));
+		}
+		TRACE(output, "0x%08x:%s.mm v%u,v%u,v%u v%u=0x%08x vl=%u\n", pc, vmlogic_name[funct6 - 0x18], vd, vs2, vs1, vd, vget(d, 0, 4), vl);
+		return SUCCESS;
+	}
+	if (funct6 == 0x10 && funct3 == 0x2) {	/* VWXUNARY0 */
+		if (vs1 == 0x00 && vm) {	/* vmv.x.s */
+			r = vsext(vget(VREG(vs2), 0, eb), eb);
+			TRACE(output, "0x%08x:vmv.x.s %s,v%u %s=0x%08x\n", pc, x_label[vd], vs2, x_label[vd], r);
+		} else if (vs1 == 0x10) {	/* vcpop.m */
+			for (i = 0, r = 0; i < vl; i++)
+				if (vm || VMASK(i))
+					r += (VREG(vs2)[i >> 3] >> (i & 7)) & 1;
+			TRACE(output, "0x%08x:vcpop.m %s,v%u%s %s=0x%08x\n", pc, x_label[vd], vs2, vm ? "" : ",v0.t", x_label[vd], r);
+		} else if (vs1 == 0x11) {	/* vfirst.m */
+			for (i = 0, r = -1; i < vl; i++)
+				if ((vm || VMASK(i)) && (VREG(vs2)[i >> 3] >> (i & 7)) & 1) {
+					r = i;
+					break;
+				}
+			TRACE(output, "0x%08x:vfirst.m %s,v%u%s %s=0x%08x\n", pc, x_label[vd], vs2, vm ? "" : ",v0.t", x_label[vd], r);
+		} else
+			return ERROR;
+		x[vd] = r;
+		return SUCCESS;
+	}
+	if (funct6 == 0x10 && funct3 == 0x6 && vs2 == 0 && vm) {	/* vmv.s.x */
+		if (vl)
+			vset(VREG(vd), 0, eb, x[vs1]);
+		TRACE(output, "0x%08x:vmv.s.x v%u,%s v%u[0]=0x%08x\n", pc, vd, x_label[vs1], vd, x[vs1]);
+		return SUCCESS;
+	}
+	if (funct6 == 0x14 && funct3 == 0x2 && vs1 == 0x11 && vs2 == 0) {	/* vid.v */
+		if (!vgroup(vd))
+			return ERROR;
+		for (i = 0; i < vl; i++)
+			if (vm || VMASK(i))
+				vset(VREG(vd), i, eb, i);
+		TRACE(output, "0x%08x:vid.v v%u%s vl=%u\n", pc, vd, vm ? "" : ",v0.t", vl);
+		return SUCCESS;
+	}
+	if (funct6 == 0x24 || funct6 == 0x25 || funct6 == 0x27) {	/* vmulhu, vmul and vmulh */
+		const char *name = funct6 == 0x24 ? "vmulhu" : funct6 == 0x25 ? "vmul" : "vmulh";
+		const uint8_t op = funct6 == 0x24 ? VK_MULHU : funct6 == 0x25 ? VK_MUL : VK_MULH;
+		if (!vgroup(vd) || !vgroup(vs2) || (funct3 == 0x2 && !vgroup(vs1)))
+			return ERROR;
+		vkernel(op, VREG(vd), VREG(vs2), funct3 == 0x2 ? VREG(vs1) : vsplat(x[vs1], vl, eb), vl, eb, vm);
+		vtrace(output, pc, name, vd, vs2, funct3, vs1, vm);
+		TRACE(output, "v%u[0]=0x%08x vl=%u\n", vd, vget(VREG(vd), 0, eb), vl);
+		return SUCCESS;
+	}
+	return ERROR;
+}
+
+void V(FILE *output, const uint32_t instruction, uint32_t pc, char *prog)
+{
+	const uint8_t funct3 = GET_FUNCT3(instruction);
+	uint8_t status = ERROR;
+
+	if (funct3 == 0x7) {
+		vsetvl(output, instruction, pc);
+		return;
+	}
+	if (!VILL()) {
+		if (funct3 == 0x0 || funct3 == 0x3 || funct3 == 0x4)
+			status = vopi(output, instruction, pc);
+		else if (funct3 == 0x2 || funct3 == 0x6)
+			status = vopm(output, instruction, pc);
+	}
+	if (status == ERROR)
+		fprintf(stderr, "%s: unknown V instruction %x\n", prog, instruction);
+}
+void Fload(FILE *output, const uint32_t instruction, uint8_t memory[], uint32_t *pc, char *prog)
+{
+	const int16_t imm = instruction >> 20;
+	const int32_t simm = (imm >> 11) ? (int32_t)(0xFFFFF000 | imm) : imm;
+
+	if (GET_FUNCT3(instruction) == 0x2)
+		flw(output, memory, GET_RD(instruction), GET_RS1(instruction), simm, *pc);
+	else if (GET_FUNCT3(instruction) == 0x0 || GET_FUNCT3(instruction) >= 0x5)
+		vmem(output, instruction, memory, pc, prog, 0);
+	else
+		fprintf(stderr, "%s: unknown I instruction %x\n", prog, instruction);
+}
+void Fstore(FILE *output, const uint32_t instruction, uint8_t memory[], uint32_t *pc, char *prog)
+{
+	const int16_t imm = ((instruction >> 7) & 0x1F) | ((instruction >> 25) << 5);
+	const int32_t simm = (imm >> 11) ? (int32_t)(0xFFFFF000 | imm) : imm;
+
+	if (GET_FUNCT3(instruction) == 0x2)
+		fsw(output, GET_RS1(instruction), GET_RS2(instruction), simm, memory, *pc);
+	else if (GET_FUNCT3(instruction) == 0x0 || GET_FUNCT3(instruction) >= 0x5)
+		vmem(output, instruction, memory, pc, prog, 1);
+	else
+		fprintf(stderr, "%s: unknown S instruction %x\n", prog, instruction);
+}
+/*
+ * Flight recorder: the last N instructions are kept as raw records in a
+ * ring and only formatted when something goes wrong.
+ */
+struct RECORD {
+	uint32_t pc;
+	uint32_t instruction;
+	uint32_t base;	/* rs1 before the instruction, for the load/store address */
+	uint32_t xd, fd;	/* x[rd] and f[rd] after it, rdfile() picks one in the dump */
+} *flight;
+uint32_t flight_mask;	/* ring size - 1, the ring is n rounded up to a power of two */
+uint32_t flight_len;	/* n */
+uint64_t flight_done;	/* icount of the last dump */
+FILE *flight_out;
+int flight_fd;	/* for the dump on a fatal signal, stderr when flight_out has no file */
+volatile sig_atomic_t flight_sig;	/* SIGINT or SIGTERM, acted on between instructions */
+
+/* effective address of a load or store with base in rs1, 0 for anything else */
+uint32_t effaddr(const uint32_t instruction, const uint8_t opcode, const uint32_t base)
+{
+	switch (opcode) {
+		case 0b0000011:
+		case 0b0000111:
+			if (opcode == 0b0000111 && GET_FUNCT3(instruction) != 0x2)
+				return base;	/* vector */
+			return base + (uint32_t)((int32_t)instruction >> 20);
+		case 0b0100011:
+		case 0b0100111:
+			if (opcode == 0b0100111 && GET_FUNCT3(instruction) != 0x2)
+				return base;
+			return base + ((uint32_t)((int32_t)instruction >> 25) << 5 | ((instruction >> 7) & 0x1F));
+		default:
+			return 0;
+	}
+}
+/* which register file rd names: 'x', 'f' or 0 when there is no destination */
+char rdfile(const uint32_t instruction)
+{
+	switch (instruction & 0x7F) {
+		case 0b0110011:
+		case 0b0010011:
+		case 0b0000011:
+		case 0b1100111:
+		case 0b0110111:
+		case 0b0010111:
+		case 0b1101111:
+			return 'x';
+		case 0b1110011:
+			return GET_FUNCT3(instruction) ? 'x' : 0;
+		case 0b0000111:
+			return GET_FUNCT3(instruction) == 0x2 ? 'f' : 0;
+		case 0b1000011:
+		case 0b1000111:
+		case 0b1001011:
+		case 0b1001111:
+			return 'f';
+		case 0b1010011:
+			switch (GET_FUNCT7(instruction)) {
+				case 0x50:
+				case 0x60:
+				case 0x70:
+					return 'x';
+				default:
+					return 'f';
+			}
+		case 0b1010111:
+			if (GET_FUNCT3(instruction) == 0x7)	/* vsetvl */
+				return 'x';
+			return GET_FUNCT3(instruction) == 0x2 && (GET_FUNCT7(instruction) >> 1) == 0x10 ? 'x' : 0;
+		default:
+			return 0;
+	}
+}
+
+/* "LO:HI" or "LO:", returns 0 if arg is neither */
+uint8_t parserange(const char *arg, struct RANGE *r)
+{
+	char *end;
+
+	r->lo = strtoull(arg, &end, 0);
+	if (*end != ':')
+		return 0;
+	r->hi = *++end ? strtoull(end, NULL, 0) : UINT64_MAX;
+	return 1;
+}
+/* decide whether this instruction gets its trace line, before any formatting */
+uint8_t traced(const uint32_t pc, const uint32_t instruction, const uint8_t opcode)
+{
+	uint8_t i;
+
+	if (!armed) {
+		if (start_pc && pc == start_pc)
+			armed = 1;
+		else if (start_store && (opcode == 0b0100011 || opcode == 0b0100111)) {
+			const uint32_t size = opcode == 0b0100011 ? 1 << GET_FUNCT3(instruction) : 4;
+			armed = start_store - effaddr(instruction, opcode, x[GET_RS1(instruction)]) < size;
+		}
+		if (!armed)
+			return 0;
+	}
+	if (icount < window.lo)
+		return 0;
+	if (icount >= window.hi) {
+		filter = 0;	/* nothing left to trace */
+		return 0;
+	}
+	if (sample > 1 && icount % sample)
+		return 0;
+	if (npcrange == 0)
+		return 1;
+	for (i = 0; i < npcrange; i++)
+		if (pc >= pcrange[i].lo && pc < pcrange[i].hi)
+			return 1;
+	return 0;
+}
+
+/* SIGINT and SIGTERM only leave a note for writefile(), see flight_stop() */
+void flight_signal(int sig)
+{
+	flight_sig = sig;
+}
+/* first record of the next dump */
+uint64_t flight_first(void)
+{
+	return icount - flight_done >= flight_len ? icount - flight_len + 1 : flight_done;
+}
+/* snprintf() isn't async-signal-safe, these are what the dump needs instead */
+char *puthex(char *p, const uint32_t v)
+{
+	int i;
+
+	*p++ = '0';
+	*p++ = 'x';
+	for (i = 28; i >= 0; i -= 4)
+		*p++ = "0123456789abcdef"[(v >> i) & 0xF];
+	return p;
+}
+char *putdec(char *p, uint64_t v)
+{
+	char d[20];
+	int n = 0;
+
+	do
+		d[n++] = '0' + v % 10;
+	while (v /= 10);
+	while (n > 0)
+		*p++ = d[--n];
+	return p;
+}
+char *putstr(char *p, const char *s)
+{
+	while (*s)
+		*p++ = *s++;
+	return p;
+}
+/* the first line of the dump */
+int flight_head(char *buf, const uint64_t first)
+{
+	char *p = putstr(buf, ">flight:last ");
+
+	p = putdec(p, icount - first + 1);
+	p = putstr(p, " of ");
+	p = putdec(p, icount + 1);
+	return putstr(p, " instructions\n") - buf;
+}
+/* one record as a line of the dump, the current instruction gets "<-" */
+int flight_line(char *buf, const struct RECORD *r, const uint8_t current)
+{
+	const uint8_t rd = GET_RD(r->instruction);
+	const uint8_t opcode = r->instruction & 0x7F;
+	const char file = rdfile(r->instruction);
+	char *p = puthex(buf, r->pc);
+
+	*p++ = ':';
+	p = puthex(p, r->instruction);
+	if (current)
+		return putstr(p, " <-\n") - buf;
+	if (file && rd != 0) {
+		*p++ = ' ';
+		p = putstr(p, file == 'f' ? f_label[rd] : x_label[rd]);
+		*p++ = '=';
+		p = puthex(p, file == 'f' ? r->fd : r->xd);
+	}
+	if (opcode == 0b0000011 || opcode == 0b0100011 || opcode == 0b0000111 || opcode == 0b0100111) {
+		p = putstr(p, " mem[");
+		p = puthex(p, effaddr(r->instruction, opcode, r->base));
+		*p++ = ']';
+	}
+	*p++ = '\n';
+	return p - buf;
+}
+/* fatal signals: no stdio, the lines go straight to the file with write() */
+void flight_crash(int sig)
+{
+	static char buf[128];
+	uint64_t i = flight_first();
+	int n;
+
+	n = flight_head(buf, i);
+	for (; write(flight_fd, buf, n) == n && i <= icount; i++)
+		n = flight_line(buf, &flight[i & flight_mask], i == icount);
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+/* between instructions after SIGINT or SIGTERM, with the current one recorded */
+void flight_stop(FILE *output)
+{
+	const int sig = flight_sig;
+
+	flight_dump(output);
+	fclose(output);	/* a compressed trace needs its last block */
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+uint8_t flight_init(uint32_t n, FILE *output)
+{
+	uint32_t size = 1;
+
+	while (size < n)
+		size <<= 1;
+	if ((flight = calloc(size, sizeof(*flight))) == NULL)
+		return ERROR;
+	flight_mask = size - 1;
+	flight_len = n;
+	flight_out = output;
+	flight_fd = fileno(output) >= 0 ? fileno(output) : STDERR_FILENO;
+	trace = 0;
+	signal(SIGINT, flight_signal);
+	signal(SIGTERM, flight_signal);
+	signal(SIGSEGV, flight_crash);
+	signal(SIGBUS, flight_crash);
+	signal(SIGFPE, flight_crash);
+	signal(SIGABRT, flight_crash);
+	return SUCCESS;
+}
+/* format what was recorded since the last dump, the current instruction last */
+void flight_dump(FILE *output)
+{
+	char buf[128];
+	uint64_t i = flight_first();
+
+	if (flight == NULL)
+		return;
+	fwrite(buf, 1, flight_head(buf, i), output);
+	for (; i <= icount; i++)
+		fwrite(buf, 1, flight_line(buf, &flight[i & flight_mask], i == icount), output);
+	flight_done = icount + 1;
+}
+
+/*
+ * Golden trace check: the trace goes to a memory stream that is compared
+ * with the mmapped reference after every instruction and then rewound.
+ */
+const char *check_ref;
+size_t check_len, check_pos;
+uint64_t check_line;	/* reference lines matched so far */
+uint8_t check_failed;
+FILE *check_out;
+char check_buf[64 * 1024];
+
+/* report the first line that differs */
+void check_fail(size_t n)
+{
+	const char *exp = check_ref + check_pos;
+	const char *e, *a;
+	size_t left = check_len - check_pos;
+	size_t i, line = 0;	/* start of the differing line in check_buf */
+
+	for (i = 0; i < n && i < left && check_buf[i] == exp[i]; i++)
+		if (check_buf[i] == '\n') {
+			line = i + 1;
+			check_line++;
+		}
+	exp += line;
+	left -= line;
+	e = memchr(exp, '\n', left);
+	a = memchr(check_buf + line, '\n', n - line);
+	fprintf(stderr, "check: mismatch at instruction %llu, reference line %llu\n", (unsigned long long)icount, (unsigned long long)check_line + 1);
+	if (left)
+		fprintf(stderr, "expected: %.*s\n", e ? (int)(e - exp) : (int)left, exp);
+	else
+		fprintf(stderr, "expected: <end of reference>\n");
+	fprintf(stderr, "actual:   %.*s\n", a ? (int)(a - (check_buf + line)) : (int)(n - line), check_buf + line);
+	check_failed = 1;
+}
+/* compare what the last instruction wrote, ERROR at the first difference */
+uint8_t check_step(void)
+{
+	size_t n, i;
+
+	fflush(check_out);
+	if ((n = ftell(check_out)) == 0)
+		return SUCCESS;
+	if (n > check_len - check_pos || memcmp(check_buf, check_ref + check_pos, n) != 0) {
+		check_fail(n);
+		return ERROR;
+	}
+	for (i = 0; i < n; i++)
+		check_line += check_buf[i] == '\n';
+	check_pos += n;
+	rewind(check_out);
+	return SUCCESS;
+}
+/*
+ * at exit: the last instruction and a reference that goes on. This is the
+ * last handler to run, so on a difference only stdio is left to flush
+ * before the exit status is changed with _exit().
+ */
+void check_end(void)
+{
+	if (check_failed)
+		return;
+	if (check_step() == SUCCESS) {
+		const char *e;
+
+		if (check_pos == check_len) {
+			fprintf(stderr, "check: all %llu lines match\n", (unsigned long long)check_line);
+			return;
+		}
+		e = memchr(check_ref + check_pos, '\n', check_len - check_pos);
+		fprintf(stderr, "check: trace ends at instruction %llu, reference line %llu\n", (unsigned long long)icount, (unsigned long long)check_line + 1);
+		fprintf(stderr, "expected: %.*s\n", e ? (int)(e - (check_ref + check_pos)) : (int)(check_len - check_pos), check_ref + check_pos);
+		fprintf(stderr, "actual:   <end of trace>\n");
+	}
+	fflush(NULL);
+	_exit(70);
+}
+FILE *check_init(const char *ref, char *prog)
+{
+	struct stat st;
+	int fd;
+
+	if ((fd = open(ref, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+		fprintf(stderr, "%s: can't open %s\n", prog, ref);
+		return NULL;
+	}
+	check_len = st.st_size;
+	check_ref = "";
+	if (check_len && (check_ref = mmap(NULL, check_len, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+		fprintf(stderr, "%s: can't map %s\n", prog, ref);
+		return NULL;
+	}
+	close(fd);
+	madvise((void *)check_ref, check_len, MADV_SEQUENTIAL);
+	if ((check_out = fmemopen(check_buf, sizeof(check_buf), "w")) == NULL)
+		return NULL;
+	setvbuf(check_out, NULL, _IONBF, 0);
+	atexit(check_end);
+	return check_out;
+}
+
+/*
+ * Compressed trace: the text is cut in blocks of ZBLOCK bytes that are
+ * compressed independently by a worker thread while the emulator goes on
+ * filling the next one. A block is first coded line by line: the
+ * "0x%08x:" prefix becomes a zigzag varint of the difference to the last
+ * pc, and the rest of the line is coded against the last line of the
+ * same pc when it has the same shape: every other byte is XORed, and
+ * every 0x%08x field becomes ZSAME when it kept its old value, the age
+ * of the value in a ring of the last ZRECENT fields coded, which catches
+ * a result read back as the operand of the next lines, or else ZDELTA
+ * and the 32 bit difference to the old value. The iterations of a loop
+ * code to the same bytes, which then go through LZ77 with a 64 KiB window
+ * and an order-0 Huffman code of the LZ bytes, kept as they are when
+ * that doesn't make them shorter.
+ *
+ * file:  "PXZ2" block...
+ * block: uint32 text length, uint32 coded length, uint32 LZ length, uint32 compressed length, compressed bytes
+ * huff:  128 bytes of 4 bit code lengths, codes LSB first
+ * line:  ZRAW length bytes | ZPC delta length bytes | ZREF delta coded-bytes
+ */
+#define ZBLOCK (1024 * 1024)
+#define ZCODE (3 * ZBLOCK + 16)	/* a block of empty lines codes to 3 bytes each */
+#define ZCOMP (ZCODE + ZCODE / 255 + 16)
+#define ZRAW 0
+#define ZPC 1
+#define ZREF 2
+#define ZLINES 4096	/* last line per pc, direct mapped */
+#define ZRECENT 16	/* field values kept for ZREF, a power of two */
+#define ZSAME 0
+#define ZDELTA (ZRECENT + 1)	/* 1 to ZRECENT are ages in the ring */
+#define ZHASH 16
+#define ZBITS 12	/* longest Huffman code */
+
+struct ZLINE {
+	uint32_t pc;
+	uint32_t off;	/* where the line follows the pc prefix in the block */
+	uint32_t len;
+};
+
+/* the last ZRECENT field values of a block */
+struct ZRING {
+	uint32_t v[ZRECENT];
+	uint32_t n;
+};
+
+struct ZSTREAM {
+	FILE *file;
+	uint8_t *fill, *work;	/* block being written and block being compressed */
+	size_t nfill, nwork;
+	uint8_t *code, *lz, *comp;	/* worker buffers */
+	uint32_t *head;	/* LZ hash table */
+	struct ZLINE *last;
+	uint8_t busy, done;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+uint32_t read32(const uint8_t *p)
+{
+	uint32_t a;
+
+	memcpy(&a, p, 4);
+	return a;
+}
+size_t zvarint(uint8_t *out, uint32_t a)
+{
+	size_t o = 0;
+
+	do {
+		out[o++] = (a & 0x7F) | (a > 0x7F ? 0x80 : 0);
+		a >>= 7;
+	} while (a);
+	return o;
+}
+size_t zvarint_read(const uint8_t *in, const size_t n, size_t i, uint32_t *a)
+{
+	uint8_t shift;
+
+	for (*a = 0, shift = 0; i < n && shift < 35; shift += 7) {
+		*a |= (uint32_t)(in[i] & 0x7F) << shift;
+		if (!(in[i++] & 0x80))
+			break;
+	}
+	return i;
+}
+/* pc of a "0x%08x:" prefix, 0 when the line doesn't start with one */
+uint8_t zpc(const uint8_t *line, const size_t len, uint32_t *pc)
+{
+	uint8_t k;
+
+	if (len < 11 || line[0] != '0' || line[1] != 'x' || line[10] != ':')
+		return 0;
+	for (*pc = 0, k = 2; k < 10; k++) {
+		if (line[k] >= '0' && line[k] <= '9')
+			*pc = *pc << 4 | (line[k] - '0');
+		else if (line[k] >= 'a' && line[k] <= 'f')
+			*pc = *pc << 4 | (line[k] - 'a' + 10);
+		else
+			return 0;
+	}
+	return 1;
+}
+
+/* value of a 0x%08x field at line[k] */
+uint8_t zhex(const uint8_t *line, const size_t k, const size_t len, uint32_t *a)
+{
+	size_t j;
+
+	if (k + 10 > len || line[k] != '0' || line[k+1] != 'x' || (k + 10 < len && isxdigit(line[k+10])))
+		return 0;
+	for (*a = 0, j = k + 2; j < k + 10; j++) {
+		if (line[j] >= '0' && line[j] <= '9')
+			*a = *a << 4 | (line[j] - '0');
+		else if (line[j] >= 'a' && line[j] <= 'f')
+			*a = *a << 4 | (line[j] - 'a' + 10);
+		else
+			return 0;
+	}
+	return 1;
+}
+/* code of field a over the old value b, with the ZDELTA bytes when there are any */
+size_t zfield(uint8_t *out, struct ZRING *r, uint32_t a, const uint32_t b)
+{
+	uint32_t age;
+
+	r->v[r->n++ & (ZRECENT - 1)] = a;
+	if (a == b) {
+		out[0] = ZSAME;
+		return 1;
+	}
+	for (age = 1; age < ZRECENT; age++)
+		if (r->v[(r->n - 1 - age) & (ZRECENT - 1)] == a) {
+			out[0] = age;
+			return 1;
+		}
+	out[0] = ZDELTA;
+	a -= b;
+	memcpy(out + 1, &a, 4);
+	return 5;
+}
+/* ZREF body of a line against the old one of the same pc, 0 if their fields don't line up */
+size_t zref_encode(const uint8_t *cur, const uint8_t *old, const size_t len, uint8_t *out, struct ZRING *r)
+{
+	struct ZRING save = *r;
+	size_t k, o = 0;
+	uint32_t a, b;
+
+	for (k = 0; k < len; k++) {
+		if (old[k] == '0' && old[k+1] == 'x' && zhex(old, k, len, &b)) {
+			if (!zhex(cur, k, len, &a)) {
+				*r = save;	/* the line goes out as ZPC */
+				return 0;
+			}
+			o += zfield(out + o, r, a, b);
+			k += 9;
+		} else
+			out[o++] = cur[k] ^ old[k];
+	}
+	return o;
+}
+
+size_t zline_encode(const uint8_t *in, const size_t n, uint8_t *out, struct ZLINE *last)
+{
+	const uint8_t *end;
+	size_t i = 0, o = 0, len, k, head;
+	uint32_t pc, prev = 0, delta;
+	struct ZLINE *l;
+	struct ZRING r;
+
+	memset(last, 0, ZLINES * sizeof(*last));
+	memset(&r, 0, sizeof(r));
+	for (; i < n; i += len) {
+		len = (end = memchr(in + i, '\n', n - i)) ? (size_t)(end - (in + i)) + 1 : n - i;
+		if (!zpc(in + i, len, &pc)) {
+			out[o++] = ZRAW;
+			o += zvarint(out + o, len);
+			memcpy(out + o, in + i, len);
+			o += len;
+			continue;
+		}
+		delta = pc - prev;
+		prev = pc;
+		l = &last[(pc >> 2) & (ZLINES - 1)];
+		head = o;
+		out[o++] = ZREF;
+		o += zvarint(out + o, (delta << 1) ^ -(delta >> 31));
+		if (l->len == len - 11 && l->pc == pc && len > 11
+				&& (k = zref_encode(in + i + 11, in + l->off, len - 11, out + o, &r)))
+			o += k;
+		else {
+			out[head] = ZPC;
+			o += zvarint(out + o, len - 11);
+			memcpy(out + o, in + i + 11, len - 11);
+			o += len - 11;
+		}
+		l->pc = pc;
+		l->off = i + 11;
+		l->len = len - 11;
+	}
+	return o;
+}
+/* returns the text length, 0 on a corrupt block */
+size_t zline_decode(const uint8_t *in, const size_t n, uint8_t *out, const size_t max, struct ZLINE *last)
+{
+	size_t i = 0, o = 0, k;
+	uint32_t pc = 0, zz, len, a, b;
+	uint8_t tag;
+	struct ZLINE *l;
+	struct ZRING r;
+
+	memset(last, 0, ZLINES * sizeof(*last));
+	memset(&r, 0, sizeof(r));
+	while (i < n) {
+		if ((tag = in[i++]) == ZRAW) {
+			i = zvarint_read(in, n, i, &len);
+			if (i + len > n || o + len > max)
+				return 0;
+			memcpy(out + o, in + i, len);
+			i += len;
+			o += len;
+			continue;
+		}
+		if (tag != ZPC && tag != ZREF)
+			return 0;
+		i = zvarint_read(in, n, i, &zz);
+		pc += (zz >> 1) ^ -(zz & 1);
+		l = &last[(pc >> 2) & (ZLINES - 1)];
+		if (tag == ZREF) {
+			if (l->pc != pc || l->off == 0)
+				return 0;
+			len = l->len;
+		} else
+			i = zvarint_read(in, n, i, &len);
+		if ((tag == ZPC && i + len > n) || o + 11 + len > max)
+			return 0;
+		sprintf((char *)out + o, "0x%08x", pc);
+		out[o+10] = ':';
+		if (tag == ZPC) {
+			memcpy(out + o + 11, in + i, len);
+			i += len;
+		} else
+			for (k = 0; k < len; k++) {
+				if (zhex(out + l->off, k, len, &b)) {
+					if (i >= n || in[i] > ZDELTA || (in[i] == ZDELTA && i + 5 > n))
+						return 0;
+					if (in[i] == ZSAME)
+						a = b;
+					else if (in[i] == ZDELTA)
+						a = b + read32(in + i + 1);
+					else
+						a = r.v[(r.n - in[i]) & (ZRECENT - 1)];
+					i += in[i] == ZDELTA ? 5 : 1;
+					r.v[r.n++ & (ZRECENT - 1)] = a;
+					sprintf((char *)out + o + 11 + k, "0x%08x", a);
+					k += 9;
+				} else if (i < n)
+					out[o+11+k] = in[i++] ^ out[l->off+k];
+				else
+					return 0;
+			}
+		l->pc = pc;
+		l->off = o + 11;
+		l->len = len;
+		o += 11 + len;
+	}
+	return o;
+}
+
+/* LZ4 style sequences: token, literal run, 16 bit offset, match length */
+size_t lz_length(uint8_t *out, size_t len)
+{
+	size_t o = 0;
+
+	for (; len >= 255; len -= 255)
+		out[o++] = 255;
+	out[o++] = len;
+	return o;
+}
+size_t lz_compress(const uint8_t *in, const size_t n, uint8_t *out, uint32_t *head)
+{
+	size_t i = 0, anchor = 0, o = 0, len, lit, k;
+	uint32_t h, m;
+
+	memset(head, 0, sizeof(uint32_t) << ZHASH);
+	while (i + 4 <= n) {
+		h = (read32(in + i) * 2654435761u) >> (32 - ZHASH);
+		m = head[h];
+		head[h] = i + 1;
+		if (m == 0 || i - --m > 0xFFFF || read32(in + m) != read32(in + i)) {
+			i++;
+			continue;
+		}
+		for (len = 4; i + len < n && in[m+len] == in[i+len]; len++)
+			;
+		lit = i - anchor;
+		out[o++] = (lit < 15 ? lit : 15) << 4 | (len - 4 < 15 ? len - 4 : 15);
+		if (lit >= 15)
+			o += lz_length(out + o, lit - 15);
+		memcpy(out + o, in + anchor, lit);
+		o += lit;
+		out[o++] = (i - m) & 0xFF;
+		out[o++] = (i - m) >> 8;
+		if (len - 4 >= 15)
+			o += lz_length(out + o, len - 4 - 15);
+		for (k = i + 1; k < i + len && k + 4 <= n; k++)
+			head[(read32(in + k) * 2654435761u) >> (32 - ZHASH)] = k + 1;
+		i += len;
+		anchor = i;
+	}
+	lit = n - anchor;	/* the last sequence has no match */
+	out[o++] = (lit < 15 ? lit : 15) << 4;
+	if (lit >= 15)
+		o += lz_length(out + o, lit - 15);
+	memcpy(out + o, in + anchor, lit);
+	return o + lit;
+}
+/* returns the decompressed length, 0 on a corrupt block */
+/* add the bytes of a long length, up to the first one under 255 */
+uint8_t lz_length_read(const uint8_t *in, const size_t n, size_t *i, size_t *len)
+{
+	uint8_t b;
+
+	do {
+		if (*i >= n)
+			return ERROR;
+		*len += b = in[(*i)++];
+	} while (b == 255);
+	return SUCCESS;
+}
+size_t lz_decompress(const uint8_t *in, const size_t n, uint8_t *out, const size_t max)
+{
+	size_t i = 0, o = 0, lit, len, off;
+
+	while (i < n) {
+		const uint8_t token = in[i++];
+		if ((lit = token >> 4) == 15 && lz_length_read(in, n, &i, &lit))
+			return 0;
+		if (i + lit > n || o + lit > max)
+			return 0;
+		memcpy(out + o, in + i, lit);
+		i += lit;
+		o += lit;
+		if (i == n)
+			break;
+		if (i + 2 > n)
+			return 0;
+		off = in[i] | in[i+1] << 8;
+		i += 2;
+		if ((len = (token & 0xF) + 4) == 19 && lz_length_read(in, n, &i, &len))
+			return 0;
+		if (off == 0 || off > o || o + len > max)
+			return 0;
+		for (; len; len--, o++)
+			out[o] = out[o - off];
+	}
+	return o;
+}
+
+/* code lengths of the bytes counted, none over ZBITS: the rare ones are made likelier until it fits */
+void huff_lengths(const uint32_t *count, uint8_t *len)
+{
+	uint32_t f[256], w[512];
+	uint16_t up[512];
+	int i, k, a, b, n, live, deep;
+
+	memcpy(f, count, sizeof(f));
+	do {
+		live = 0;
+		for (i = 0; i < 256; i++)
+			live += (w[i] = f[i]) != 0;
+		for (n = 256; live > 1; n++, live--) {
+			a = b = -1;
+			for (i = 0; i < n; i++)
+				if (w[i] && (a < 0 || w[i] < w[a])) {
+					b = a;
+					a = i;
+				} else if (w[i] && (b < 0 || w[i] < w[b]))
+					b = i;
+			w[n] = w[a] + w[b];
+			up[a] = up[b] = n;
+			w[a] = w[b] = 0;
+		}
+		deep = 0;
+		for (i = 0; i < 256; i++) {
+			len[i] = 0;
+			if (f[i])
+				for (len[i] = 1, k = i; n > 256 && up[k] != n - 1; k = up[k])
+					len[i]++;
+			deep = len[i] > deep ? len[i] : deep;
+		}
+		for (i = 0; i < 256; i++)
+			f[i] = f[i] ? f[i] >> 1 | 1 : 0;
+	} while (deep > ZBITS);
+}
+/* canonical codes, bit reversed to go out LSB first; ERROR if the lengths oversubscribe */
+uint8_t huff_codes(const uint8_t *len, uint32_t *code)
+{
+	uint32_t next = 0, c, r;
+	int l, s, k;
+
+	for (l = 1; l <= ZBITS; l++) {
+		for (s = 0; s < 256; s++)
+			if (len[s] == l) {
+				for (c = next++, r = 0, k = 0; k < l; k++, c >>= 1)
+					r = r << 1 | (c & 1);
+				code[s] = r;
+			}
+		if (next > 1u << l)
+			return ERROR;
+		next <<= 1;
+	}
+	return SUCCESS;
+}
+/* returns the coded length, n when coding doesn't pay and the bytes are copied */
+size_t huff_compress(const uint8_t *in, const size_t n, uint8_t *out)
+{
+	uint32_t count[256] = {0}, code[256];
+	uint8_t len[256];
+	uint64_t bits = 0, total = 0;
+	size_t i, o = 128;
+	unsigned nbits = 0;
+
+	for (i = 0; i < n; i++)
+		count[in[i]]++;
+	huff_lengths(count, len);
+	huff_codes(len, code);
+	for (i = 0; i < 256; i++)
+		total += (uint64_t)count[i] * len[i];
+	if (128 + (total + 7) / 8 >= n) {
+		memcpy(out, in, n);
+		return n;
+	}
+	for (i = 0; i < 128; i++)
+		out[i] = len[2*i] | len[2*i+1] << 4;
+	for (i = 0; i < n; i++) {
+		bits |= (uint64_t)code[in[i]] << nbits;
+		nbits += len[in[i]];
+		for (; nbits >= 8; nbits -= 8, bits >>= 8)
+			out[o++] = bits;
+	}
+	if (nbits)
+		out[o++] = bits;
+	return o;
+}
+/* returns the decoded length, less than max on a corrupt block */
+size_t huff_decompress(const uint8_t *in, const size_t n, uint8_t *out, const size_t max)
+{
+	uint16_t table[1 << ZBITS] = {0};	/* symbol | length << 8 */
+	uint32_t code[256], bits = 0, j;
+	uint8_t len[256];
+	size_t i, o;
+	unsigned nbits = 0;
+	uint16_t e;
+
+	if (n == max) {
+		memcpy(out, in, n);
+		return n;
+	}
+	if (n < 128)
+		return 0;
+	for (i = 0; i < 128; i++) {
+		len[2*i] = in[i] & 0xF;
+		len[2*i+1] = in[i] >> 4;
+		if (len[2*i] > ZBITS || len[2*i+1] > ZBITS)
+			return 0;
+	}
+	if (huff_codes(len, code))
+		return 0;
+	for (i = 0; i < 256; i++)
+		for (j = 0; len[i] && j < 1u << (ZBITS - len[i]); j++)
+			table[code[i] | j << len[i]] = i | len[i] << 8;
+	for (i = 128, o = 0; o < max; o++) {
+		for (; nbits <= 24 && i < n; nbits += 8)
+			bits |= (uint32_t)in[i++] << nbits;
+		e = table[bits & ((1 << ZBITS) - 1)];
+		if ((e >> 8) == 0 || (e >> 8) > nbits)
+			return o;
+		out[o] = e & 0xFF;
+		bits >>= e >> 8;
+		nbits -= e >> 8;
+	}
+	return o;
+}
+
+void zwrite_block(struct ZSTREAM *z, const uint8_t *block, const size_t n)
+{
+	const uint32_t ncode = zline_encode(block, n, z->code, z->last);
+	const uint32_t nlz = lz_compress(z->code, ncode, z->lz, z->head);
+	const uint32_t ncomp = huff_compress(z->lz, nlz, z->comp);
+	const uint32_t ntext = n;
+
+	fwrite(&ntext, 4, 1, z->file);
+	fwrite(&ncode, 4, 1, z->file);
+	fwrite(&nlz, 4, 1, z->file);
+	fwrite(&ncomp, 4, 1, z->file);
+	fwrite(z->comp, 1, ncomp, z->file);
+}
+void *zworker(void *arg)
+{
+	struct ZSTREAM *z = arg;
+
+	pthread_mutex_lock(&z->lock);
+	for (;;) {
+		while (!z->busy && !z->done)
+			pthread_cond_wait(&z->cond, &z->lock);
+		if (!z->busy)
+			break;
+		pthread_mutex_unlock(&z->lock);
+		zwrite_block(z, z->work, z->nwork);
+		pthread_mutex_lock(&z->lock);
+		z->busy = 0;
+		pthread_cond_broadcast(&z->cond);
+	}
+	pthread_mutex_unlock(&z->lock);
+	return NULL;
+}
+/* hand the filled block to the worker once it is done with the last one */
+void zflush(struct ZSTREAM *z)
+{
+	uint8_t *t;
+
+	pthread_mutex_lock(&z->lock);
+	while (z->busy)
+		pthread_cond_wait(&z->cond, &z->lock);
+	t = z->work;
+	z->work = z->fill;
+	z->nwork = z->nfill;
+	z->fill = t;
+	z->nfill = 0;
+	z->busy = 1;
+	pthread_cond_broadcast(&z->cond);
+	pthread_mutex_unlock(&z->lock);
+}
+ssize_t zcookie_write(void *cookie, const char *buf, size_t size)
+{
+	struct ZSTREAM *z = cookie;
+	size_t n, left = size;
+
+	while (left) {
+		n = ZBLOCK - z->nfill < left ? ZBLOCK - z->nfill : left;
+		memcpy(z->fill + z->nfill, buf, n);
+		z->nfill += n;
+		buf += n;
+		left -= n;
+		if (z->nfill == ZBLOCK)
+			zflush(z);
+	}
+	return size;
+}
+int zcookie_close(void *cookie)
+{
+	struct ZSTREAM *z = cookie;
+
+	if (z->nfill)
+		zflush(z);
+	pthread_mutex_lock(&z->lock);
+	z->done = 1;
+	pthread_cond_broadcast(&z->cond);
+	pthread_mutex_unlock(&z->lock);
+	pthread_join(z->thread, NULL);
+	return fclose(z->file);
+}
+
+FILE *zout;
+void zclose(void)
+{
+	fclose(zout);
+}
+/* wrap output in a compressing stream, closed at exit */
+FILE *zopen(FILE *output)
+{
+	cookie_io_functions_t io = { NULL, zcookie_write, NULL, zcookie_close };
+	struct ZSTREAM *z = calloc(1, sizeof(*z));
+
+	if (z == NULL)
+		return NULL;
+	z->file = output;
+	z->fill = malloc(ZBLOCK);
+	z->work = malloc(ZBLOCK);
+	z->code = malloc(ZCODE);
+	z->lz = malloc(ZCOMP);
+	z->comp = malloc(ZCOMP);
+	z->head = malloc(sizeof(uint32_t) << ZHASH);
+	z->last = malloc(ZLINES * sizeof(struct ZLINE));
+	if (!z->fill || !z->work || !z->code || !z->lz || !z->comp || !z->head || !z->last)
+		return NULL;
+	pthread_mutex_init(&z->lock, NULL);
+	pthread_cond_init(&z->cond, NULL);
+	if (pthread_create(&z->thread, NULL, zworker, z))
+		return NULL;
+	fwrite("PXZ2", 1, 4, output);
+	if ((zout = fopencookie(z, "w", io)) == NULL)
+		return NULL;
+	setvbuf(zout, NULL, _IOFBF, 64 * 1024);
+	atexit(zclose);
+	return zout;
+}
+/* --decompress: back to the plain text trace */
+uint8_t unpack(FILE *input, FILE *output, char *prog, char *arq1)
+{
+	uint8_t magic[4];
+	uint32_t ntext, ncode, nlz, ncomp;
+	uint8_t *text = malloc(ZBLOCK + 1);	/* room for the NUL of sprintf */
+	uint8_t *code = malloc(ZCODE);
+	uint8_t *lz = malloc(ZCOMP);
+	uint8_t *comp = malloc(ZCOMP);
+	struct ZLINE *last = malloc(ZLINES * sizeof(struct ZLINE));
+	uint8_t status = ERROR;
+
+	if (!text || !code || !lz || !comp || !last || fread(magic, 1, 4, input) != 4 || memcmp(magic, "PXZ2", 4) != 0) {
+		fprintf(stderr, "%s: %s is not a compressed trace\n", prog, arq1);
+		goto out;
+	}
+	while (fread(&ntext, 4, 1, input) == 1) {
+		if (fread(&ncode, 4, 1, input) != 1 || fread(&nlz, 4, 1, input) != 1 || fread(&ncomp, 4, 1, input) != 1
+				|| ntext > ZBLOCK || ncode > ZCODE || nlz > ZCOMP || ncomp > nlz || fread(comp, 1, ncomp, input) != ncomp
+				|| huff_decompress(comp, ncomp, lz, nlz) != nlz || lz_decompress(lz, nlz, code, ncode) != ncode || zline_decode(code, ncode, text, ntext, last) != ntext) {
+			fprintf(stderr, "%s: %s: corrupt block\n", prog, arq1);
+			goto out;
+		}
+		fwrite(text, 1, ntext, output);
+	}
+	status = SUCCESS;
+out:	/* every return frees the buffers, free(NULL) is fine */
+	free(text);
+	free(code);
+	free(lz);
+	free(comp);
+	free(last);
+	return status;
+}
+
+/*
+ * Lockstep: one program over many initial states. The lanes that agree on
+ * the pc form a group that decodes each instruction once; its registers
+ * are a struct of arrays, lx[r][slot], so the ALU ops run over all the
+ * slots with the vector kernels and lw, sw and the branches with one loop
+ * each. The other integer instructions call the scalar handlers per slot
+ * with just rs1, rs2 and rd swapped in, and the rest (csr, traps, F, V)
+ * with the whole lane state. A lane that wants a
+ * different pc than most of the group after a branch, a jump or a trap
+ * leaves it, and runs on its own with the scalar interpreter once the
+ * group is done.
+ */
+#define MAX_LANES 1024
+#define LANE_MEMORY (64 * 1024 + 4)	/* posi is 16 bits: wild stores stay in the lane */
+#define NCSR (CSR_VLENB + 1)
+#define VK_NONE 0xFF
+#define LANE_HALT 0xFFFFFFFF	/* next pc of a lane that stopped */
+
+struct LANE {
+	uint32_t pc;	/* after it left the group */
+	uint32_t csr[NCSR];
+	uint32_t f[32];
+	uint8_t v[32][VLENB];
+	uint8_t *memory;
+	uint64_t icount;
+	int code;	/* exit code, -1 while it runs */
+} lane[MAX_LANES];
+uint32_t lx[32][MAX_LANES] __attribute__((aligned(32)));
+uint32_t lid[MAX_LANES];	/* lane in each slot, the group is slots 0 to n-1 */
+uint8_t *lmem[MAX_LANES];	/* memory of each slot */
+uint32_t lnext[MAX_LANES];	/* next pc of each slot */
+uint32_t limm[MAX_LANES] __attribute__((aligned(32)));	/* splatted immediate */
+uint32_t limm_a, limm_n;
+FILE *lane_log;	/* the handlers write here, lane_flush() tags it with the lane */
+char lane_buf[4096];
+
+/* ALU ops with a kernel, by funct7 (0x00, 0x20, 0x01) and funct3 */
+const uint8_t lane_op[3][8] = {
+	{ VK_ADD, VK_SLL, VK_NONE, VK_NONE, VK_XOR, VK_SRL, VK_OR, VK_AND },
+	{ VK_SUB, VK_NONE, VK_NONE, VK_NONE, VK_NONE, VK_SRA, VK_NONE, VK_NONE },
+	{ VK_MUL, VK_MULH, VK_NONE, VK_MULHU, VK_NONE, VK_NONE, VK_NONE, VK_NONE }
+};
+
+uint8_t lanes_init(const char *path, uint8_t memory[], char *prog)
+{
+	FILE *input;
+	char line[4096], *tok, *val;
+	uint32_t r, addr, word;
+	struct LANE *l;
+
+	if ((input = fopen(path, "r")) == NULL) {
+		fprintf(stderr, "%s: can't open %s\n", prog, path);
+		return ERROR;
+	}
+	while (fgets(line, sizeof(line), input)) {
+		if ((tok = strchr(line, '#')))
+			*tok = '\0';
+		if (line[strspn(line, " \t\r\n")] == '\0')
+			continue;
+		if (nlanes == MAX_LANES) {
+			fprintf(stderr, "%s: %s: more than %d lanes\n", prog, path, MAX_LANES);
+			return ERROR;
+		}
+		l = &lane[nlanes];
+		if ((l->memory = calloc(1, LANE_MEMORY)) == NULL) {
+			fprintf(stderr, "%s: can't allocate lane %u\n", prog, nlanes);
+			return ERROR;
+		}
+		memcpy(l->memory, memory, MAX_MEMORY);
+		for (r = 0; r < NCSR; r++)
+			l->csr[r] = csr[r].x;
+		l->pc = OFFSET;
+		l->code = -1;
+		for (r = 0; r < 32; r++)
+			lx[r][nlanes] = x[r];
+		for (tok = strtok(line, " \t\r\n"); tok; tok = strtok(NULL, " \t\r\n")) {
+			if ((val = strchr(tok, '=')) == NULL)
+				break;
+			*val++ = '\0';
+			word = strtoul(val, NULL, 0);
+			if (tok[0] == '@') {
+				addr = strtoul(tok + 1, NULL, 0) - OFFSET;
+				if (addr > MAX_MEMORY - 4 || addr % 4)
+					break;
+				memcpy(l->memory + addr, &word, 4);
+				continue;
+			}
+			for (r = 1; r < 32 && strcmp(tok, x_label[r]) != 0; r++)
+				;
+			if (r == 32)
+				break;
+			lx[r][nlanes] = word;
+		}
+		if (tok) {
+			fprintf(stderr, "%s: %s: lane %u: bad setting %s\n", prog, path, nlanes, tok);
+			return ERROR;
+		}
+		nlanes++;
+	}
+	fclose(input);
+	if (nlanes == 0) {
+		fprintf(stderr, "%s: %s: no lanes\n", prog, path);
+		return ERROR;
+	}
+	return SUCCESS;
+}
+
+uint8_t *lane_splat(const uint32_t a, const uint32_t n)
+{
+	uint32_t s;
+
+	if (a != limm_a || n > limm_n) {
+		for (s = 0; s < n; s++)
+			limm[s] = a;
+		limm_a = a;
+		limm_n = n;
+	}
+	return (uint8_t *)limm;
+}
+void lane_slt(uint32_t *d, const uint32_t *a, const uint32_t *b, const uint32_t n, const uint8_t u)
+{
+	uint32_t s;
+
+	if (u)
+		for (s = 0; s < n; s++)
+			d[s] = a[s] < b[s];
+	else
+		for (s = 0; s < n; s++)
+			d[s] = (int32_t)a[s] < (int32_t)b[s];
+}
+/* the ALU ops run over the n slots of the group at once, 0 if it isn't one */
+uint8_t lane_simd(const uint32_t instruction, const uint32_t n)
+{
+	const uint8_t rd = GET_RD(instruction);
+	const uint8_t rs1 = GET_RS1(instruction);
+	const uint8_t funct3 = GET_FUNCT3(instruction);
+	const uint8_t funct7 = GET_FUNCT7(instruction);
+	const int16_t imm = instruction >> 20;
+	const int32_t simm = (imm >> 11) ? (int32_t)(0xFFFFF000 | imm) : imm;
+	uint8_t op = VK_NONE;
+
+	switch (instruction & 0x7F) {
+		case 0b0110011:
+			if (funct7 == 0x00 && (funct3 == 0x2 || funct3 == 0x3)) {
+				if (rd)
+					lane_slt(lx[rd], lx[rs1], lx[GET_RS2(instruction)], n, funct3 == 0x3);
+				return 1;
+			}
+			if (funct7 == 0x00 || funct7 == 0x20 || funct7 == 0x01)
+				op = lane_op[funct7 == 0x00 ? 0 : funct7 == 0x20 ? 1 : 2][funct3];
+			if (op == VK_NONE)
+				return 0;
+			if (rd)
+				vkernel(op, (uint8_t *)lx[rd], (uint8_t *)lx[rs1], (uint8_t *)lx[GET_RS2(instruction)], n, 4, 1);
+			return 1;
+		case 0b0010011:
+			if (funct3 == 0x2 || funct3 == 0x3) {
+				if (rd)
+					lane_slt(lx[rd], lx[rs1], (uint32_t *)lane_splat(simm, n), n, funct3 == 0x3);
+				return 1;
+			}
+			if (funct3 == 0x1 || funct3 == 0x5)	/* shifts: the imm7 part picks the op */
+				op = (funct7 & ~0x20) == 0x00 ? lane_op[funct7 >> 5][funct3] : VK_NONE;
+			else
+				op = lane_op[0][funct3];
+			if (op == VK_NONE)
+				return 0;
+			if (rd)
+				vkernel(op, (uint8_t *)lx[rd], (uint8_t *)lx[rs1], lane_splat(simm, n), n, 4, 1);
+			return 1;
+		case 0b0110111:	/* lui */
+			if (rd)
+				memcpy(lx[rd], lane_splat(instruction & 0xFFFFF000, n), n * 4);
+			return 1;
+	}
+	return 0;
+}
+/* integer instructions that only touch rs1, rs2, rd, memory and pc */
+uint8_t lane_light(const uint32_t instruction)
+{
+	const int16_t imm = instruction >> 20;
+
+	switch (instruction & 0x7F) {
+		case 0b0000011:	/* the loads Iload() doesn't trap */
+			return imm % 4 == 0 && GET_RD(instruction) != 0 && GET_RS1(instruction) != 0;
+		case 0b0100011:
+			return GET_RS1(instruction) != 0;
+		case 0b0110011:
+		case 0b0010011:
+		case 0b1100011:
+		case 0b0010111:
+		case 0b1101111:
+		case 0b1100111:
+			return 1;
+	}
+	return 0;
+}
+
+/* one slot through the scalar handlers, with only rs1, rs2 and rd swapped in */
+uint32_t lane_step(const uint32_t instruction, const uint32_t s, const uint32_t pc, char *prog)
+{
+	const uint8_t rd = GET_RD(instruction);
+	const uint8_t rs1 = GET_RS1(instruction);
+	const uint8_t rs2 = GET_RS2(instruction);
+	uint32_t next;
+
+	x[rd] = lx[rd][s];
+	x[rs1] = lx[rs1][s];
+	x[rs2] = lx[rs2][s];
+	x[0] = 0;
+	next = execute(lane_log, instruction, lmem[s], pc, prog);
+	if (rd)
+		lx[rd][s] = x[rd];
+	return next;
+}
+/* lw and sw over the group, the odd loads go through lane_step() */
+uint8_t lane_mem(const uint32_t instruction, const uint32_t n, const uint32_t pc, char *prog)
+{
+	const uint8_t opcode = instruction & 0x7F;
+	const uint8_t rd = GET_RD(instruction);
+	const uint8_t rs1 = GET_RS1(instruction);
+	const uint8_t rs2 = GET_RS2(instruction);
+	const int16_t imm = opcode == 0b0100011 ? ((instruction >> 7) & 0x1F) | ((instruction >> 25) << 5) : instruction >> 20;
+	const int32_t simm = (imm >> 11) ? (int32_t)(0xFFFFF000 | imm) : imm;
+	uint16_t posi;
+	uint32_t s;
+
+	if ((opcode != 0b0000011 && opcode != 0b0100011) || GET_FUNCT3(instruction) != 0x2 || !lane_light(instruction))
+		return 0;
+	for (s = 0; s < n; s++) {
+		posi = lx[rs1][s] + simm - OFFSET;
+		if (opcode == 0b0100011)
+			memcpy(lmem[s] + posi, &lx[rs2][s], 4);
+		else if (posi % 4 == 0 && posi < MAX_MEMORY - 4)
+			memcpy(&lx[rd][s], lmem[s] + posi, 4);
+		else
+			lane_step(instruction, s, pc, prog);
+	}
+	return 1;
+}
+/* next pc of every slot for a branch, worked out as B() does */
+uint8_t lane_branch(const uint32_t instruction, const uint32_t n, const uint32_t pc)
+{
+	const int16_t imm = ((instruction >> 31) << 11) | (((instruction >> 25) & 0x3F) << 4) | (((instruction >> 8) & 0xF)) | (((instruction >> 7) & 0b1) << 10);
+	const int32_t simm = (imm >> 11) ? (int32_t)(0xFFFFF000 | imm) : imm;
+	const uint32_t *a = lx[GET_RS1(instruction)];
+	const uint32_t *b = lx[GET_RS2(instruction)];
+	const uint32_t taken = simm ? pc + ((uint32_t)simm << 1) : pc + 4;
+	uint32_t s;
+
+	if ((instruction & 0x7F) != 0b1100011)
+		return 0;
+	switch (GET_FUNCT3(instruction)) {
+		case 0x0:
+			for (s = 0; s < n; s++)
+				lnext[s] = a[s] == b[s] ? taken : pc + 4;
+			break;
+		case 0x1:
+			for (s = 0; s < n; s++)
+				lnext[s] = a[s] != b[s] ? taken : pc + 4;
+			break;
+		case 0x4:
+			for (s = 0; s < n; s++)
+				lnext[s] = (int32_t)a[s] < (int32_t)b[s] ? taken : pc + 4;
+			break;
+		case 0x5:
+			for (s = 0; s < n; s++)
+				lnext[s] = (int32_t)a[s] >= (int32_t)b[s] ? taken : pc + 4;
+			break;
+		case 0x6:
+			for (s = 0; s < n; s++)
+				lnext[s] = a[s] < b[s] ? taken : pc + 4;
+			break;
+		case 0x7:
+			for (s = 0; s < n; s++)
+				lnext[s] = a[s] >= b[s] ? taken : pc + 4;
+			break;
+		default:
+			return 0;
+	}
+	return 1;
+}
+
+/* the state of slot s in and out of the scalar globals */
+void lane_load(const uint32_t s, const uint8_t vector)
+{
+	const struct LANE *l = &lane[lid[s]];
+	uint8_t r;
+
+	for (r = 0; r < 32; r++)
+		x[r] = lx[r][s];
+	for (r = 0; r < NCSR; r++)
+		csr[r].x = l->csr[r];
+	memcpy(f, l->f, sizeof(f));
+	if (vector)
+		memcpy(v, l->v, sizeof(v));
+	fcsr_load(CSR_FCSR);
+}
+void lane_save(const uint32_t s, const uint8_t vector)
+{
+	struct LANE *l = &lane[lid[s]];
+	uint8_t r;
+
+	fcsr_sync();
+	for (r = 1; r < 32; r++)
+		lx[r][s] = x[r];
+	for (r = 0; r < NCSR; r++)
+		l->csr[r] = csr[r].x;
+	memcpy(l->f, f, sizeof(f));
+	if (vector)
+		memcpy(l->v, v, sizeof(v));
+}
+/* copy what the handlers wrote for lane l to the output */
+void lane_flush(FILE *output, const uint32_t l)
+{
+	const long n = ftell(lane_log);
+
+	if (n > 0) {
+		fprintf(output, "lane %u:%.*s", l, (int)n, lane_buf);
+		rewind(lane_log);
+	}
+}
+void lane_swap(const uint32_t a, const uint32_t b)
+{
+	uint32_t t;
+	uint8_t *m;
+	uint8_t r;
+
+	for (r = 1; r < 32; r++) {
+		t = lx[r][a];
+		lx[r][a] = lx[r][b];
+		lx[r][b] = t;
+	}
+	t = lid[a];
+	lid[a] = lid[b];
+	lid[b] = t;
+	t = lnext[a];
+	lnext[a] = lnext[b];
+	lnext[b] = t;
+	m = lmem[a];
+	lmem[a] = lmem[b];
+	lmem[b] = m;
+}
+/* the group goes on at the next pc most of its lanes agree on, returns its new size */
+uint32_t lane_split(uint32_t n, uint32_t *pc)
+{
+	uint32_t s, votes = 0, major = lnext[0];
+
+	for (s = 1; s < n && lnext[s] == major; s++)
+		;
+	if (s == n && major != LANE_HALT) {
+		*pc = major;
+		return n;
+	}
+	for (s = 0; s < n; s++)
+		if (lnext[s] != LANE_HALT) {
+			if (votes == 0)
+				major = lnext[s];
+			votes += lnext[s] == major ? 1 : -1;
+		}
+	for (s = 0; s < n;) {
+		if (lnext[s] == major && major != LANE_HALT) {
+			s++;
+			continue;
+		}
+		if (lnext[s] != LANE_HALT)
+			lane[lid[s]].pc = lnext[s];
+		lane[lid[s]].icount = icount - (lnext[s] == LANE_HALT);	/* a solo run exits before counting the ecall */
+		lane_swap(s, --n);
+	}
+	*pc = major;
+	return n;
+}
+/* a lane that left the group, alone until it stops */
+void lane_run(FILE *output, const uint32_t s, char *prog)
+{
+	struct LANE *l = &lane[lid[s]];
+	uint32_t pc = l->pc;
+
+	lane_load(s, 1);
+	lane_halt = -1;
+	while (lane_halt < 0 && pc - OFFSET < MAX_MEMORY) {
+		pc = execute(lane_log, ((uint32_t *)(lmem[s] + pc - OFFSET))[0], lmem[s], pc, prog);
+		x[0] = 0;
+		l->icount += lane_halt < 0;
+		lane_flush(output, lid[s]);
+	}
+	lane_save(s, 1);
+	l->pc = pc;
+	l->code = lane_halt < 0 ? 0 : lane_halt;
+}
+
+uint8_t lockstep(FILE *output, char *prog)
+{
+	uint32_t pc = OFFSET, n = nlanes, s, l, alone;
+	uint8_t r;
+
+	if ((lane_log = fmemopen(lane_buf, sizeof(lane_buf), "w")) == NULL)
+		return ERROR;
+	setvbuf(lane_log, NULL, _IONBF, 0);
+	for (s = 0; s < nlanes; s++) {
+		lid[s] = s;
+		lmem[s] = lane[s].memory;
+	}
+	while (n && pc - OFFSET < MAX_MEMORY) {
+		const uint32_t instruction = ((uint32_t *)(lmem[0] + pc - OFFSET))[0];
+		const uint8_t opcode = instruction & 0x7F;
+		const uint8_t vector = opcode == 0b1010111 || opcode == 0b0000111 || opcode == 0b0100111;
+
+		icount++;
+		if (lane_simd(instruction, n) || lane_mem(instruction, n, pc, prog)) {
+			pc += 4;
+			continue;
+		}
+		if (lane_branch(instruction, n, pc)) {
+			n = lane_split(n, &pc);
+			continue;
+		}
+		if (lane_light(instruction)) {
+			for (s = 0; s < n; s++)
+				lnext[s] = lane_step(instruction, s, pc, prog);
+			if (opcode != 0b1101111 && opcode != 0b1100111) {	/* only jal and jalr move the pc */
+				pc += 4;
+				continue;
+			}
+		} else
+			for (s = 0; s < n; s++) {
+				lane_load(s, vector);
+				lane_halt = -1;
+				lnext[s] = execute(lane_log, instruction, lmem[s], pc, prog);
+				x[0] = 0;
+				lane_save(s, vector);
+				lane_flush(output, lid[s]);
+				if (lane_halt >= 0) {
+					lane[lid[s]].pc = lnext[s];
+					lane[lid[s]].code = lane_halt;
+					lnext[s] = LANE_HALT;
+				}
+			}
+		n = lane_split(n, &pc);
+	}
+	for (s = 0; s < n; s++) {
+		lane[lid[s]].pc = pc;
+		lane[lid[s]].icount = icount;
+		lane[lid[s]].code = 0;
+	}
+	for (alone = 0; s < nlanes; s++)
+		if (lane[lid[s]].code < 0) {
+			lane_run(output, s, prog);
+			alone++;
+		}
+	for (s = 0; s < nlanes; s++)
+		lnext[lid[s]] = s;	/* slot of each lane */
+	for (l = 0; l < nlanes; l++) {
+		s = lnext[l];
+		fprintf(output, "lane %u: exit=%d pc=0x%08x instructions=%llu", l, lane[l].code, lane[l].pc, (unsigned long long)lane[l].icount);
+		for (r = 0; r < 32; r++)
+			fprintf(output, " %s=0x%08x", x_label[r], lx[r][s]);
+		fputc('\n', output);
+	}
+	fprintf(stderr, "lockstep: %u lanes, %u finished alone\n", nlanes, alone);
+	return SUCCESS;
+}
+
+/*
+ * Heatmap: every fetch, load and store is counted against its 64 byte
+ * line in flat arrays. One data access in HEAT_SAMPLE also gets its reuse
+ * distance, the number of other lines touched since the last access to
+ * its line, by scanning the last access clock of all the lines. The lines
+ * touched are kept in bitmaps that give the working set at the end of
+ * each window of HEAT_WINDOW instructions, and each load/store pc keeps
+ * its last address to follow its stride.
+ *
+ * file:   "PXH1" uint32 line bytes, lines, window, sample
+ *         uint64 instructions, data accesses, accesses outside the memory
+ *         uint64 read[lines], write[lines], fetch[lines]
+ *         uint64 reuse[HEAT_BUCKETS + 1]: distance 0, 1, 2-3, 4-7, ..., then first touch
+ *         uint32 windows, then uint16 data lines, code lines per window
+ *         uint32 pcs, then uint32 pc, accesses, int32 stride, uint32 repeats per pc
+ */
+#define HEAT_LINE 64
+#define HEAT_LINES (MAX_MEMORY / HEAT_LINE)
+#define HEAT_WINDOW 65536	/* instructions */
+#define HEAT_SAMPLE 64
+#define HEAT_BUCKETS 11
+
+struct STRIDE {
+	uint32_t addr;	/* last one */
+	int32_t last;	/* last stride */
+	int32_t stride;	/* most common stride, by majority vote */
+	uint32_t votes;
+	uint32_t n;
+	uint32_t repeats;	/* accesses with the same stride as the one before */
+	uint8_t store;
+} heat_pc[MAX_MEMORY / 4];
+uint64_t heat_read[HEAT_LINES], heat_write[HEAT_LINES], heat_fetch[HEAT_LINES];
+uint64_t heat_last[HEAT_LINES];	/* clock of the last data access, 0 for none */
+uint64_t heat_reuse[HEAT_BUCKETS + 1];
+uint64_t heat_clock;	/* data accesses */
+uint64_t heat_outside;
+uint64_t heat_data_ws[HEAT_LINES / 64], heat_code_ws[HEAT_LINES / 64];	/* lines touched in this window */
+uint16_t *heat_window;	/* data and code lines per window */
+uint32_t heat_nwindow, heat_maxwindow;
+uint64_t heat_stop;	/* instruction where the windows couldn't grow and collection stopped, 0 while it goes on */
+FILE *heat_out;
+
+void heat_data(const uint32_t addr, const uint8_t store)
+{
+	const uint32_t line = (addr - OFFSET) / HEAT_LINE;
+	uint32_t k, d;
+
+	if (line >= HEAT_LINES) {
+		heat_outside++;
+		return;
+	}
+	heat_clock++;
+	if (store)
+		heat_write[line]++;
+	else
+		heat_read[line]++;
+	heat_data_ws[line / 64] |= 1ULL << (line % 64);
+	if (heat_clock % HEAT_SAMPLE == 0) {
+		if (heat_last[line] == 0)
+			heat_reuse[HEAT_BUCKETS]++;
+		else {
+			for (k = d = 0; k < HEAT_LINES; k++)
+				d += heat_last[k] > heat_last[line];
+			heat_reuse[d ? 64 - __builtin_clzll(d) : 0]++;
+		}
+	}
+	heat_last[line] = heat_clock;
+}
+void heat_stride(const uint32_t pc, const uint32_t addr, const uint8_t store)
+{
+	struct STRIDE *p = &heat_pc[(pc - OFFSET) / 4];
+	const int32_t stride = addr - p->addr;
+
+	if (p->n) {
+		p->repeats += p->n > 1 && stride == p->last;
+		if (p->votes == 0)
+			p->stride = stride;
+		p->votes += stride == p->stride ? 1 : -1;
+		p->last = stride;
+	}
+	p->addr = addr;
+	p->store = store;
+	p->n++;
+}
+/*
+ * the active elements of a vector load or store, one access per line they
+ * cross, from vmem() once it knows they are all in memory
+ */
+void heat_vector(const uint32_t pc, const uint32_t instruction, const uint8_t store)
+{
+	const uint8_t vm = (instruction >> 25) & 1;
+	const uint8_t width = GET_FUNCT3(instruction);
+	const uint8_t eb = width == 0x0 ? 1 : width == 0x5 ? 2 : width == 0x6 ? 4 : 0;
+	const int32_t stride = ((instruction >> 26) & 0x3) == 0x2 ? (int32_t)x[GET_RS2(instruction)] : eb;
+	const uint32_t base = x[GET_RS1(instruction)];
+	uint32_t i, line = UINT32_MAX;
+
+	if (heat_out == NULL || heat_stop)
+		return;
+	for (i = 0; i < VL(); i++)
+		if ((vm || VMASK(i)) && (base + stride * i - OFFSET) / HEAT_LINE != line) {
+			line = (base + stride * i - OFFSET) / HEAT_LINE;
+			heat_data(base + stride * i, store);
+		}
+	heat_stride(pc, base, store);
+}
+void heat_window_end(void)
+{
+	uint16_t *w;
+	uint8_t k;
+
+	if (heat_nwindow == heat_maxwindow) {
+		const uint32_t max = heat_maxwindow ? 2 * heat_maxwindow : 256;
+		if ((w = realloc(heat_window, max * 2 * sizeof(uint16_t))) == NULL) {
+			fprintf(stderr, "heatmap: can't allocate %u windows, stopped at instruction %llu\n", max, (unsigned long long)icount);
+			heat_stop = icount;
+			return;
+		}
+		heat_window = w;
+		heat_maxwindow = max;
+	}
+	heat_window[2*heat_nwindow] = heat_window[2*heat_nwindow+1] = 0;
+	for (k = 0; k < HEAT_LINES / 64; k++) {
+		heat_window[2*heat_nwindow] += __builtin_popcountll(heat_data_ws[k]);
+		heat_window[2*heat_nwindow+1] += __builtin_popcountll(heat_code_ws[k]);
+		heat_data_ws[k] = heat_code_ws[k] = 0;
+	}
+	heat_nwindow++;
+}
+/* before the instruction runs, while rs1 still holds the address */
+void heat_step(const uint32_t pc, const uint32_t instruction, const uint8_t opcode)
+{
+	const uint32_t line = (pc - OFFSET) / HEAT_LINE;
+	const uint8_t store = opcode == 0b0100011 || opcode == 0b0100111;
+	const uint32_t addr = effaddr(instruction, opcode, x[GET_RS1(instruction)]);
+
+	if (heat_stop)
+		return;
+	if (icount && icount % HEAT_WINDOW == 0)
+		heat_window_end();
+	heat_fetch[line]++;
+	heat_code_ws[line / 64] |= 1ULL << (line % 64);
+	switch (opcode) {
+		case 0b0000011:	/* the accesses Iload() and S() trap on don't reach memory */
+			if ((int16_t)(instruction >> 20) % 4 != 0 || GET_RD(instruction) == 0)
+				return;
+			/* fall through */
+		case 0b0100011:
+			if (GET_RS1(instruction) == 0)
+				return;
+			heat_data(addr, store);
+			heat_stride(pc, addr, store);
+			return;
+		case 0b0000111:
+		case 0b0100111:
+			if (GET_FUNCT3(instruction) != 0x2)
+				return;	/* see vmem() */
+			heat_data(addr, store);
+			heat_stride(pc, addr, store);
+			return;
+	}
+}
+
+/* at exit: the file and a summary on stderr */
+void heat_end(void)
+{
+	const uint32_t head[] = { HEAT_LINE, HEAT_LINES, HEAT_WINDOW, HEAT_SAMPLE };
+	const uint64_t count[] = { heat_stop ? heat_stop : icount, heat_clock, heat_outside };
+	uint64_t reads = 0, writes = 0, sampled = 0, sum = 0;
+	uint32_t k, j, npc = 0, data = 0, code = 0, lo = UINT32_MAX, hi = 0, top[8] = { 0 }, ntop = 0;
+
+	if (!heat_stop && (icount % HEAT_WINDOW || heat_nwindow == 0))
+		heat_window_end();
+	fwrite("PXH1", 1, 4, heat_out);
+	fwrite(head, sizeof(head), 1, heat_out);
+	fwrite(count, sizeof(count), 1, heat_out);
+	fwrite(heat_read, sizeof(heat_read), 1, heat_out);
+	fwrite(heat_write, sizeof(heat_write), 1, heat_out);
+	fwrite(heat_fetch, sizeof(heat_fetch), 1, heat_out);
+	fwrite(heat_reuse, sizeof(heat_reuse), 1, heat_out);
+	fwrite(&heat_nwindow, 4, 1, heat_out);
+	fwrite(heat_window, 2 * sizeof(uint16_t), heat_nwindow, heat_out);
+	for (k = 0; k < MAX_MEMORY / 4; k++)
+		npc += heat_pc[k].n != 0;
+	fwrite(&npc, 4, 1, heat_out);
+	for (k = 0; k < MAX_MEMORY / 4; k++)
+		if (heat_pc[k].n) {
+			const uint32_t rec[] = { OFFSET + 4 * k, heat_pc[k].n, heat_pc[k].stride, heat_pc[k].repeats };
+			fwrite(rec, sizeof(rec), 1, heat_out);
+		}
+	fclose(heat_out);
+
+	for (k = 0; k < HEAT_LINES; k++) {
+		reads += heat_read[k];
+		writes += heat_write[k];
+		data += heat_read[k] || heat_write[k];
+		code += heat_fetch[k] != 0;
+	}
+	fprintf(stderr, "heatmap: %llu instructions, %llu reads, %llu writes, %llu outside the memory\n", (unsigned long long)count[0], (unsigned long long)reads, (unsigned long long)writes, (unsigned long long)heat_outside);
+	fprintf(stderr, "heatmap: %u data and %u code lines of %u bytes touched\n", data, code, HEAT_LINE);
+	for (k = 0; k < heat_nwindow; k++) {
+		lo = heat_window[2*k] < lo ? heat_window[2*k] : lo;
+		hi = heat_window[2*k] > hi ? heat_window[2*k] : hi;
+		sum += heat_window[2*k];
+	}
+	if (heat_nwindow)
+		fprintf(stderr, "heatmap: data working set per %u instructions: min %u, mean %.1f, max %u lines\n", HEAT_WINDOW, lo, (double)sum / heat_nwindow, hi);
+	for (k = 0; k <= HEAT_BUCKETS; k++)
+		sampled += heat_reuse[k];
+	fprintf(stderr, "heatmap: reuse distance, 1 in %u accesses:", HEAT_SAMPLE);
+	for (k = 0; k <= HEAT_BUCKETS && sampled; k++)
+		if (heat_reuse[k]) {
+			if (k == HEAT_BUCKETS)
+				fprintf(stderr, " first %.1f%%", 100.0 * heat_reuse[k] / sampled);
+			else if (k < 2)
+				fprintf(stderr, " %u:%.1f%%", k, 100.0 * heat_reuse[k] / sampled);
+			else
+				fprintf(stderr, " %u-%u:%.1f%%", 1 << (k - 1), (1 << k) - 1, 100.0 * heat_reuse[k] / sampled);
+		}
+	fputc('\n', stderr);
+	for (k = 0; k < MAX_MEMORY / 4; k++) {	/* busiest load/store pcs */
+		if (heat_pc[k].n == 0 || (ntop == 8 && heat_pc[k].n <= heat_pc[top[7]].n))
+			continue;
+		for (j = ntop < 8 ? ntop++ : 7; j > 0 && heat_pc[top[j-1]].n < heat_pc[k].n; j--)
+			top[j] = top[j-1];
+		top[j] = k;
+	}
+	for (k = 0; k < ntop; k++) {
+		const struct STRIDE *p = &heat_pc[top[k]];
+		fprintf(stderr, "heatmap: 0x%08x %s %u times, stride %+d, %.1f%% repeat\n", OFFSET + 4 * top[k], p->store ? "store" : "load", p->n, p->stride, p->n > 2 ? 100.0 * p->repeats / (p->n - 2) : 0.0);
+	}
+}
+FILE *heat_init(const char *path, char *prog)
+{
+	if ((heat_out = fopen(path, "wb")) == NULL) {
+		fprintf(stderr, "%s: can't open %s\n", prog, path);
+		return NULL;
+	}
+	atexit(heat_end);
+	return heat_out;
+}
+
+/*
+ * Stats: with --stats, one line of JSON on stderr at exit with the
+ * instructions run, the time taken by readfile and by the run, the CPU
+ * time of the whole process (threads included) and the peak RSS, for
+ * bench/run.sh. With --lanes the instructions of all the
+ * lanes are added up.
+ */
+uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+void stats_end(void)
+{
+	const uint64_t run_ns = run_start ? now_ns() - run_start : 0;
+	uint64_t n = icount, cpu_ns;
+	struct rusage ru;
+	uint32_t l;
+
+	if (nlanes)
+		for (n = 0, l = 0; l < nlanes; l++)
+			n += lane[l].icount;
+	getrusage(RUSAGE_SELF, &ru);
+	cpu_ns = (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000ULL + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000ULL;
+	fprintf(stderr, "{\"instructions\":%llu,\"load_ns\":%llu,\"run_ns\":%llu,\"cpu_ns\":%llu,\"ns_per_instruction\":%.3f,\"mips\":%.2f,\"max_rss_kb\":%ld}\n",
+		(unsigned long long)n, (unsigned long long)load_ns, (unsigned long long)run_ns, (unsigned long long)cpu_ns,
+		n ? (double)run_ns / n : 0.0, run_ns ? 1000.0 * n / run_ns : 0.0, ru.ru_maxrss);
+}
+
+/*
+ * Record/replay: --record writes the machine state every N instructions,
+ * with the pages of memory changed since the last checkpoint, found by
+ * comparing with a shadow copy. The first checkpoint has all the pages:
+ * memory past the image is not initialised, and is the only input a run
+ * does not get from the .hex file. --replay applies the checkpoints up to
+ * the last one at or before the --window start, restores the registers
+ * from it and runs to the window end. Lines written whether or not the
+ * instruction is traced, like >exception, start at that checkpoint.
+ * file:       "PXR1" uint32 hash of the .hex file, N, page bytes
+ * checkpoint: struct CHECKPOINT, then the pages set in dirty
+ */
+#define REC_PAGE 1024
+#define REC_PAGES (MAX_MEMORY / REC_PAGE)
+_Static_assert(REC_PAGES <= 32, "CHECKPOINT.dirty has a bit per page");
+
+struct CHECKPOINT {
+	uint64_t icount;
+	uint32_t pc;
+	uint32_t x[32];
+	uint32_t f[32];
+	uint32_t csr[NCSR];
+	uint8_t v[32][VLENB];
+	uint32_t dirty;	/* bit per page */
+};
+FILE *rec_out;
+uint64_t rec_next;	/* icount of the next checkpoint */
+uint32_t rec_every;
+uint8_t rec_shadow[MAX_MEMORY];
+
+/* FNV-1a of the whole input file */
+uint32_t rec_hash(FILE *input)
+{
+	uint32_t h = 2166136261u;
+	int c;
+
+	rewind(input);
+	while ((c = getc(input)) != EOF)
+		h = (h ^ c) * 16777619u;
+	return h;
+}
+void checkpoint(const uint8_t memory[], const uint32_t pc)
+{
+	struct CHECKPOINT c;
+	uint32_t p;
+	uint8_t r;
+
+	fcsr_sync();
+	memset(&c, 0, sizeof(c));
+	c.icount = icount;
+	c.pc = pc;
+	for (r = 0; r < 32; r++)
+		c.x[r] = x[r];
+	for (r = 0; r < NCSR; r++)
+		c.csr[r] = csr[r].x;
+	memcpy(c.f, f, sizeof(c.f));
+	memcpy(c.v, v, sizeof(c.v));
+	for (p = 0; p < REC_PAGES; p++)
+		if (icount == 0 || memcmp(memory + p * REC_PAGE, rec_shadow + p * REC_PAGE, REC_PAGE))
+			c.dirty |= 1u << p;
+	fwrite(&c, sizeof(c), 1, rec_out);
+	for (p = 0; p < REC_PAGES; p++)
+		if (c.dirty & 1u << p) {
+			fwrite(memory + p * REC_PAGE, REC_PAGE, 1, rec_out);
+			memcpy(rec_shadow + p * REC_PAGE, memory + p * REC_PAGE, REC_PAGE);
+		}
+	rec_next += rec_every;
+}
+FILE *rec_init(const char *path, uint32_t every, FILE *input, char *prog)
+{
+	const uint32_t head[] = { rec_hash(input), every, REC_PAGE };
+
+	if ((rec_out = fopen(path, "wb")) == NULL) {
+		fprintf(stderr, "%s: can't open %s\n", prog, path);
+		return NULL;
+	}
+	fwrite("PXR1", 1, 4, rec_out);
+	fwrite(head, sizeof(head), 1, rec_out);
+	rec_every = every;
+	return rec_out;
+}
+uint8_t replay_init(const char *path, FILE *input, uint8_t memory[], char *prog)
+{
+	struct CHECKPOINT c, last;
+	uint32_t head[3], p;
+	char magic[4];
+	uint8_t found = 0, r;
+	FILE *in;
+
+	if ((in = fopen(path, "rb")) == NULL) {
+		fprintf(stderr, "%s: can't open %s\n", prog, path);
+		return ERROR;
+	}
+	if (fread(magic, 4, 1, in) != 1 || memcmp(magic, "PXR1", 4) || fread(head, sizeof(head), 1, in) != 1 || head[2] != REC_PAGE) {
+		fprintf(stderr, "%s: %s is not a recording\n", prog, path);
+		fclose(in);
+		return ERROR;
+	}
+	if (head[0] != rec_hash(input)) {
+		fprintf(stderr, "%s: %s was recorded from another program\n", prog, path);
+		fclose(in);
+		return ERROR;
+	}
+	while (fread(&c, sizeof(c), 1, in) == 1 && c.icount <= window.lo) {
+		for (p = 0; p < REC_PAGES; p++)
+			if (c.dirty & 1u << p && fread(memory + p * REC_PAGE, REC_PAGE, 1, in) != 1) {
+				fprintf(stderr, "%s: %s is truncated\n", prog, path);
+				fclose(in);
+				return ERROR;
+			}
+		last = c;
+		found = 1;
+	}
+	fclose(in);
+	if (!found) {
+		fprintf(stderr, "%s: no checkpoint in %s\n", prog, path);
+		return ERROR;
+	}
+	for (r = 0; r < 32; r++)
+		x[r] = last.x[r];
+	for (r = 0; r < NCSR; r++)
+		csr[r].x = last.csr[r];
+	memcpy(f, last.f, sizeof(f));
+	memcpy(v, last.v, sizeof(v));
+	fcsr_load(CSR_FCSR);
+	icount = last.icount;
+	replay_pc = last.pc;
+	replaying = 1;
+	fprintf(stderr, "replay: from instruction %llu\n", (unsigned long long)icount);
+	return SUCCESS;
+}
+
+/* one instruction, returns the pc of the next one */
+uint32_t execute(FILE *output, const uint32_t instruction, uint8_t memory[], uint32_t pc, char *prog)
+{
+	const uint8_t opcode = instruction & 0x7F;
+
+	switch (opcode) {
+		case 0b0110011:
+			R(output, instruction, memory, pc, prog);
+			break;
+		case 0b0010011:
+		case 0b0000011:
+		case 0b1100111:
+		case 0b1110011:
+			I(output, instruction, memory, &pc, prog, opcode);
+			break;
+		case 0b0100011:
+			S(output, instruction, memory, pc, prog);
+			break;
+		case 0b1100011:
+			B(output, instruction, &pc, prog);
+			break;
+		case 0b0110111:
+		case 0b0010111:
+			U(output, instruction, pc, prog, opcode);
+			break;
+		case 0b1101111:
+			J(output, instruction, &pc, prog);
+			break;
+		case 0b0000111:
+			Fload(output, instruction, memory, &pc, prog);
+			break;
+		case 0b0100111:
+			Fstore(output, instruction, memory, &pc, prog);
+			break;
+		case 0b1000011:
+		case 0b1000111:
+		case 0b1001011:
+		case 0b1001111:
+			R4(output, instruction, pc, prog, opcode);
+			break;
+		case 0b1010011:
+			F(output, instruction, pc, prog);
+			break;
+		case 0b1010111:
+			V(output, instruction, pc, prog);
+			break;
+		default:
+			//mstatus
+			csr[0].x = 0x00001800;
+			//mcause
+			csr[4].x = 0x1;
+			// pc = mtvec
+			pc = csr[2].x - 4;
+			flight_dump(output);
+			fprintf(output, ">exception:instruction_fault cause=0x%08x,epc=0x%08x,tval=0x%08x\n", csr[4].x, csr[3].x, csr[5].x);
+			// mtval = instruction
+			csr[5].x = instruction;
+			printf("unknown opcode. %x\n", instruction);
+			break;
+	}
+	return pc + 4;
+}
+
+uint8_t writefile(FILE *output, uint8_t memory[], char *prog)
+{
+	uint32_t pc = replaying ? replay_pc : OFFSET;
+	struct RECORD *r = NULL;
+
+	while ((pc - OFFSET) < MAX_MEMORY) {
+		const uint32_t instruction = ((uint32_t *)(memory+pc-OFFSET))[0];
+		const uint8_t opcode = instruction & 0x7F;
+		if (rec_out && icount == rec_next)
+			checkpoint(memory, pc);
+		if (replaying && icount >= window.hi)
+			break;
+		if (filter)
+			trace = traced(pc, instruction, opcode);
+		if (flight) {
+			r = &flight[icount & flight_mask];
+			r->pc = pc;
+			r->instruction = instruction;
+			r->base = x[GET_RS1(instruction)];
+			if (flight_sig)
+				flight_stop(output);
+		}
+		if (heat_out)
+			heat_step(pc, instruction, opcode);
+		pc = execute(output, instruction, memory, pc, prog);
+		x[0] = 0;
+		if (r) {
+			r->xd = x[GET_RD(instruction)];
+			r->fd = f[GET_RD(instruction)];
+		}
+		if (check_out && check_step())
+			exit(70);
+		icount++;
 	}
 	return SUCCESS;
 }